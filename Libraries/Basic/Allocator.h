@@ -118,7 +118,7 @@ T* memzero(T* ptr) { return (T*)memzero(ptr, sizeof(T)); }
 
 #define MEMZERO(ptr) memzero((ptr), sizeof(*(ptr)))
 
-#if __has_feature(memory_sanitizer)
+#if __has_feature(address_sanitizer)
 C_API void __asan_poison_memory_region(void const volatile *addr, usize size);
 C_API void __asan_unpoison_memory_region(void const volatile *addr, usize size);
 C_INLINE void mempoison(void const volatile* addr, u64 size) { __asan_poison_memory_region(addr, size); }
@@ -7,6 +7,12 @@ static constexpr u64 MiB = 1024 * KiB;
 static constexpr u64 GiB = 1024 * KiB;
 static constexpr u64 TiB = 1024 * GiB;
 
+#if defined(__APPLE__) && defined(__aarch64__)
+static constexpr u64 cache_line_size = 128;
+#else
+static constexpr u64 cache_line_size = 64;
+#endif
+
 C_INLINE void ty_trans_migrate_impl(u64* buf, u64 stored_version, u64 new_version)
 {
     stored_version /= sizeof(u64);
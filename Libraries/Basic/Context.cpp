@@ -1,6 +1,7 @@
 #include "./Context.h"
 
 #include "./Bits.h"
+#include "./Defer.h"
 #include "./FileLogger.h"
 #include "./FixedArena.h"
 #include "./Allocator.h"
@@ -16,6 +17,7 @@
 #include <stb/sprintf.h>
 
 #ifndef NDEBUG
+#include <dlfcn.h>
 #include <libgen.h>
 #endif
 
@@ -25,6 +27,16 @@ extern thread_local bool g_context_is_initialized;
 thread_local Context* g_context;
 thread_local bool g_context_is_initialized = 0;
 
+static thread_local TemporaryArenaStats g_temp_stats;
+
+static constexpr u8 swept_poison = 0xA5;
+
+[[gnu::format(printf, 2, 0)]]
+static c_string vprint_from(void const* site, c_string fmt, va_list args);
+static void* push_from(void const* site, u64 size, u64 align);
+static void poison_swept(u8* from, u8* to);
+static c_string site_name(void const* site);
+
 C_API void push_context(Context* next)
 {
     VERIFY(g_context_is_initialized);
@@ -105,19 +117,24 @@ C_API c_string tprint(c_string fmt, ...)
 {
     va_list args;
     va_start(args, fmt);
-    c_string result = tvprint(fmt, args);
+    c_string result = vprint_from(__builtin_return_address(0), fmt, args);
     va_end(args);
     return result;
 }
 
 C_API c_string tvprint(c_string fmt, va_list args)
+{
+    return vprint_from(__builtin_return_address(0), fmt, args);
+}
+
+static c_string vprint_from(void const* site, c_string fmt, va_list args)
 {
     int len = stb_vsnprintf(nullptr, 0, fmt, args);
     if (len < 0) return nullptr;
     if (len == 0) return "";
-    char* buf = (char*)tpush(len + 1, 1);
-    memzero(buf, len + 1);
+    char* buf = (char*)push_from(site, len + 1, 1);
     if (!buf) return nullptr;
+    memzero(buf, len + 1);
     int len2 = stb_vsnprintf(buf, len + 1, fmt, args);
     VERIFY(len == len2);
     return buf;
@@ -134,7 +151,7 @@ C_API KError tprints(StringSlice* out, c_string fmt, ...)
 
 C_API KError tvprints(StringSlice* out, c_string fmt, va_list args)
 {
-    c_string result = tvprint(fmt, args);
+    c_string result = vprint_from(__builtin_return_address(0), fmt, args);
     if (!result)
         return kerror_unix(ENOMEM);
     *out = sv_from_c_string(result);
@@ -148,43 +165,56 @@ C_API Allocator* temporary_arena(void)
 
 C_API void* tpush(u64 size, u64 align)
 {
-    return context()->temp_arena->push(size, align);
+    return push_from(__builtin_return_address(0), size, align);
 }
 
 C_API void* tclone(void const* data, u64 size, u64 align)
 {
-    return memclone(&context()->temp_arena->allocator, data, size, align);
+    void* ptr = push_from(__builtin_return_address(0), size, align);
+    if (!ptr) return nullptr;
+    __builtin_memcpy(ptr, data, size);
+    return ptr;
 }
 
 C_API void const* tmark(void)
 {
+    g_temp_stats.mark_count += 1;
     return context()->temp_arena->mark().value;
 }
 
 C_API void tsweep(void const* address)
 {
-    context()->temp_arena->sweep(make_fixed_mark((u8*)address));
+    FixedArena* arena = context()->temp_arena;
+    poison_swept((u8*)address, arena->head);
+    arena->sweep(make_fixed_mark((u8*)address));
+    g_temp_stats.sweep_count += 1;
+}
+
+C_API void reset_temporary_arena_quiet(void)
+{
+    FixedArena* arena = context()->temp_arena;
+    poison_swept(arena->base, arena->head);
+    arena->drain();
+    g_temp_stats.reset_count += 1;
 }
 
 C_API void reset_temporary_arena(void)
 {
+    reset_temporary_arena_quiet();
+
 #ifndef NDEBUG
+    // NOTE: Reported after the drain, logging formats into this arena, so
+    //       an overflow can only be reported once there is room again.
     {
-        static thread_local u64 last_used;
-        static thread_local u64 last_max;
-        static thread_local u32 report;
-        report++;
-        u64 used = tbytes_used();
-        u64 max = context()->temp_arena->largest_size;
-        if (last_used != used || last_max != max || report % 5000 == 0) {
-            u64 left = tbytes_left();
-            debugf("arena used: %lu left: %lu allocations: %lu max used: %lu", used, left, context()->temp_arena->allocation_count, max);
-        }
-        last_max = max;
-        last_used = used;
+        static thread_local u64 last_high_water;
+        static thread_local u64 last_failed_count;
+        auto* stats = &g_temp_stats;
+        if (stats->failed_count != last_failed_count || stats->high_water != last_high_water || stats->reset_count % 5000 == 0)
+            log_temporary_arena_stats();
+        last_high_water = stats->high_water;
+        last_failed_count = stats->failed_count;
     }
 #endif
-    context()->temp_arena->drain();
 }
 
 C_API u64 tbytes_used(void)
@@ -197,6 +227,91 @@ C_API u64 tbytes_left(void)
     return context()->temp_arena->bytes_left();
 }
 
+C_API TemporaryArenaStats temporary_arena_stats(void)
+{
+    TemporaryArenaStats stats = g_temp_stats;
+    FixedArena const* arena = context()->temp_arena;
+    stats.capacity = arena->end - arena->base;
+    return stats;
+}
+
+C_API void log_temporary_arena_stats(void)
+{
+    // NOTE: Formatting the report allocates from the arena it reports on,
+    //       the counters are put back afterwards so the next report only
+    //       shows what the caller did.
+    auto stats = temporary_arena_stats();
+    TemporaryArenaStats saved = g_temp_stats;
+    void const* mark = tmark();
+    defer [=] {
+        tsweep(mark);
+        g_temp_stats = saved;
+    };
+    infof("temporary arena: high water %lu of %lu, allocations: %lu, marks: %lu, sweeps: %lu, resets: %lu, largest: %lu from %s",
+        stats.high_water, stats.capacity, stats.allocation_count, stats.mark_count, stats.sweep_count, stats.reset_count,
+        stats.largest_allocation, site_name(stats.largest_allocation_site));
+    if (stats.mark_count != stats.sweep_count)
+        warnf("temporary arena: %ld marks were never swept", (i64)(stats.mark_count - stats.sweep_count));
+    if (stats.failed_count != 0)
+        warnf("temporary arena: %lu pushes did not fit, last was %lu bytes from %s", stats.failed_count, stats.last_failed_size, site_name(stats.last_failed_site));
+}
+
+static void* push_from(void const* site, u64 size, u64 align)
+{
+    (void)site;
+    FixedArena* arena = context()->temp_arena;
+    auto* stats = &g_temp_stats;
+    void* ptr = arena->push(size, align);
+    if (!ptr) {
+        stats->failed_count += 1;
+        stats->last_failed_size = size;
+#ifndef NDEBUG
+        stats->last_failed_site = site;
+#endif
+        return nullptr;
+    }
+
+    stats->allocation_count += 1;
+    u64 used = arena->bytes_used();
+    if (used > stats->high_water)
+        stats->high_water = used;
+    if (size > stats->largest_allocation) {
+        stats->largest_allocation = size;
+#ifndef NDEBUG
+        stats->largest_allocation_site = site;
+#endif
+    }
+    return ptr;
+}
+
+static void poison_swept(u8* from, u8* to)
+{
+    // NOTE: Reads through a pointer that outlived its sweep now see a
+    //       pattern instead of plausible old data. ASan builds already
+    //       poison swept memory, and the range holds poisoned gaps between
+    //       pushes, so writing to it there would trap.
+#if !defined(NDEBUG) && !__has_feature(address_sanitizer)
+    if (to > from)
+        __builtin_memset(from, swept_poison, to - from);
+#else
+    (void)from;
+    (void)to;
+#endif
+}
+
+static c_string site_name(void const* site)
+{
+#ifndef NDEBUG
+    Dl_info info;
+    if (site && dladdr(site, &info) && info.dli_sname)
+        return tprint("%s+%lu", info.dli_sname, (u64)((u8 const*)site - (u8 const*)info.dli_saddr));
+    if (site)
+        return tprint("%p", site);
+#endif
+    (void)site;
+    return "unknown";
+}
+
 C_API void print(c_string fmt, ...)   { va_list args; va_start(args, fmt); vprint(fmt, args);  va_end(args); }
 C_API void debugf_(c_string fmt, ...) { va_list args; va_start(args, fmt); vdebugf(fmt, args); va_end(args); }
 C_API void infof_(c_string fmt, ...)  { va_list args; va_start(args, fmt); vinfof(fmt, args);  va_end(args); }
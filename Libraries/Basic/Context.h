@@ -65,9 +65,35 @@ C_API void* tclone(void const*, u64 size, u64 align);
 C_API void const* tmark(void);
 C_API void tsweep(void const*);
 C_API void reset_temporary_arena(void);
+// NOTE: Debug builds report the arena stats from reset_temporary_arena()
+//       when they change, which formats and resolves symbols. Real time
+//       threads reset with this instead and never report.
+C_API void reset_temporary_arena_quiet(void);
 C_API u64 tbytes_used(void);
 C_API u64 tbytes_left(void);
 
+// NOTE: Per thread, kept across arenas, so threads that put a new arena in
+//       their context every callback (audio) still get one running total.
+//       Allocations through temporary_arena() are not counted.
+typedef struct TemporaryArenaStats {
+    u64 capacity; // Of the arena in the current context.
+    u64 high_water;
+    u64 allocation_count;
+    u64 failed_count;
+    u64 mark_count;
+    u64 sweep_count;
+    u64 reset_count;
+    u64 largest_allocation;
+
+    // NOTE: Callers of tpush() and friends, only recorded in debug builds.
+    void const* largest_allocation_site;
+    void const* last_failed_site;
+    u64 last_failed_size;
+} TemporaryArenaStats;
+
+C_API TemporaryArenaStats temporary_arena_stats(void);
+C_API void log_temporary_arena_stats(void);
+
 #define TPUSH(T) ((T*)tpush(sizeof(T), alignof(T)))
 #define TCLONE(value) ((__typeof(value))tclone((value), sizeof(__typeof(*value)), alignof(__typeof(*value))))
 
@@ -4,11 +4,20 @@
 #include "./Types.h"
 #include "./Verify.h"
 #include "./BitSet.h"
+#include "./PageAllocator.h"
 
 #include <stb/sprintf.h>
 
+#include <sys/mman.h>
+
+// NOTE: Committing page by page would be one mprotect per page, granules
+//       keep the syscall count down while still tracking use closely.
+constexpr u64 virtual_commit_granule = 64 * 1024;
+
 static void* dispatch(Allocator*, AllocatorEvent);
 static bool owns(FixedArena const* arena, void* ptr);
+static bool commit_to(FixedArena*, u8* end);
+static void decommit_above(FixedArena*, u8* head);
 
 C_API FixedArena fixed_arena_init(void* memory, u64 size)
 {
@@ -22,9 +31,41 @@ C_API FixedArena fixed_arena_init(void* memory, u64 size)
         .end = ((u8*)memory) + size,
         .allocation_count = 0,
         .largest_size = 0,
+        .committed = ((u8*)memory) + size,
+        .commit_granule = 0,
+        .decommit = false,
     };
 }
 
+C_API [[nodiscard]] bool fixed_arena_init_virtual(u64 reserve_size, bool decommit, FixedArena* out)
+{
+    if (!C_ASSERT(reserve_size != 0)) return false;
+    u64 granule = virtual_commit_granule > page_size() ? virtual_commit_granule : page_size();
+    u64 size = __builtin_align_up(reserve_size, granule);
+
+    void* memory = mmap(nullptr, size, PROT_NONE, MAP_ANON|MAP_PRIVATE|MAP_NORESERVE, -1, 0);
+    if (memory == MAP_FAILED) return false;
+
+    *out = fixed_arena_init(memory, size);
+    out->committed = out->base;
+    out->commit_granule = granule;
+    out->decommit = decommit;
+    return true;
+}
+
+C_API void fixed_arena_deinit_virtual(FixedArena* arena)
+{
+    VERIFY(arena->commit_granule != 0);
+    munmap(arena->base, arena->end - arena->base);
+    memzero(arena);
+}
+
+u64 FixedArena::bytes_committed() const { return fixed_arena_bytes_committed(this); }
+C_API u64 fixed_arena_bytes_committed(FixedArena const* arena)
+{
+    return arena->committed - arena->base;
+}
+
 u64 FixedArena::bytes_used() const { return fixed_arena_bytes_used(this); }
 C_API u64 fixed_arena_bytes_used(FixedArena const* arena)
 {
@@ -46,6 +87,8 @@ C_API void fixed_arena_drain(FixedArena* arena)
     arena->head = arena->base;
     mempoison(arena->head, size);
     arena->allocation_count = 0;
+    if (arena->decommit)
+        decommit_above(arena, arena->head);
 }
 
 FixedMark FixedArena::mark() const { return fixed_arena_mark(this); }
@@ -63,6 +106,8 @@ C_API void fixed_arena_sweep(FixedArena* arena, FixedMark mark)
     uptr size = arena->head - mark.value;
     arena->head = mark.value;
     mempoison(arena->head, size);
+    if (arena->decommit)
+        decommit_above(arena, arena->head);
 }
 
 void* FixedArena::push(u64 size, u64 align) { return fixed_arena_push(this, size, align); }
@@ -76,6 +121,8 @@ C_API void* fixed_arena_push(FixedArena* arena, u64 size, u64 align)
     if (!C_ASSERT(new_head != nullptr)) return nullptr;
     if ((new_head + size) > arena->end)
         return nullptr;
+    if ((new_head + size) > arena->committed && !commit_to(arena, new_head + size))
+        return nullptr;
     arena->head = new_head;
     VERIFY(((uptr)arena->head) % align == 0);
     void* ptr = arena->head;
@@ -157,6 +204,41 @@ static bool owns(FixedArena const* arena, void* ptr)
     return m <= arena->end && m >= arena->base;
 }
 
+static bool commit_to(FixedArena* arena, u8* end)
+{
+    if (arena->commit_granule == 0) return false;
+    u8* new_committed = __builtin_align_up(end, arena->commit_granule);
+    if (new_committed > arena->end) new_committed = arena->end;
+    if (mprotect(arena->committed, new_committed - arena->committed, PROT_READ|PROT_WRITE) < 0)
+        return false;
+#ifdef __APPLE__
+    // NOTE: Pairs with MADV_FREE_REUSABLE in decommit_above(), so the pages
+    //       count against our footprint again.
+    madvise(arena->committed, new_committed - arena->committed, MADV_FREE_REUSE);
+#endif
+    arena->committed = new_committed;
+    return true;
+}
+
+static void decommit_above(FixedArena* arena, u8* head)
+{
+    // NOTE: One granule past head stays committed, so a loop that pushes
+    //       and sweeps around a boundary does not fault on every round.
+    if (arena->commit_granule == 0) return;
+    u8* keep = __builtin_align_up(head, arena->commit_granule) + arena->commit_granule;
+    if (keep >= arena->committed) return;
+    u64 size = arena->committed - keep;
+#ifdef __APPLE__
+    // NOTE: MADV_DONTNEED only drops the pages from the pmap on Darwin, they
+    //       stay resident and charged to us until the kernel gets to them.
+    madvise(keep, size, MADV_FREE_REUSABLE);
+#else
+    madvise(keep, size, MADV_DONTNEED);
+#endif
+    mprotect(keep, size, PROT_NONE);
+    arena->committed = keep;
+}
+
 static void fixed_arena_free(FixedArena* arena, void* ptr, u64 size, u64 align)
 {
     (void)align;
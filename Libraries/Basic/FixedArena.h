@@ -14,12 +14,20 @@ typedef struct FixedArena {
     u64 allocation_count;
     u64 largest_size;
 
+    // NOTE: Only used by virtual arenas, where [base, end) is reserved up
+    //       front and pages become read/write as head moves past committed.
+    u8* committed;
+    u64 commit_granule; // Zero for arenas over caller owned memory.
+    bool decommit;      // Give pages back to the OS on drain() and sweep().
+
 #ifdef __cplusplus
     u64 bytes_used() const;
     u64 bytes_left() const;
 
     void drain();
 
+    u64 bytes_committed() const;
+
     FixedMark mark() const;
     void sweep(FixedMark mark);
 
@@ -42,6 +50,13 @@ typedef struct FixedArena {
 C_API FixedArena fixed_arena_init(void* memory, u64 size);
 C_API [[nodiscard]] bool fixed_arena_init_with_capacity(Allocator*, u64 size, u64 align, FixedArena*);
 
+// NOTE: Reserves reserve_size bytes of address space without backing it,
+//       the arena then commits as it grows, so resident memory tracks use
+//       rather than the worst case. Release with fixed_arena_deinit_virtual.
+C_API [[nodiscard]] bool fixed_arena_init_virtual(u64 reserve_size, bool decommit, FixedArena*);
+C_API void fixed_arena_deinit_virtual(FixedArena*);
+C_API u64 fixed_arena_bytes_committed(FixedArena const*);
+
 C_API u64 fixed_arena_bytes_used(FixedArena const*);
 C_API u64 fixed_arena_bytes_left(FixedArena const*);
 C_API void fixed_arena_drain(FixedArena*);
@@ -0,0 +1,203 @@
+#include "./MPSCMailbox.h"
+
+#include "./Allocator.h"
+#include "./Verify.h"
+#include "./PageAllocator.h"
+#include "./TypeId.h"
+#include "./Bits.h"
+#include "./Error.h"
+
+#include <errno.h>
+#include <string.h>
+#include <sys/mman.h>
+
+typedef enum : u32 {
+    MessageState_Empty = 0, // Zeroed by the reader, not claimed or not written yet.
+    MessageState_Ready,
+} MessageState;
+
+typedef struct Message {
+    _Atomic MessageState state;
+    u16 tag;
+    u16 align;
+    u32 size;
+    u32 stride;
+    u8 data[];
+} Message;
+static_assert(sizeof(Message) == 16);
+
+constexpr u64 message_stride_align = 8;
+
+static u64 stride_for(u64 size, u64 align);
+static u8* message_data(Message const*);
+static Message* message_at(MPSCMailbox const*, u64 offset);
+static Message const* read_ptr(MPSCMailbox const*);
+static void consume(MPSCMailbox*, Message const*);
+static bool is_readable(void*);
+
+C_API KError mpsc_mailbox_init(u32 min_capacity, MPSCMailbox* mb)
+{
+    if (verify(min_capacity != 0).failed) return kerror_unix(EINVAL);
+    VERIFY(!ty_is_initialized(mb));
+
+    u64 capacity = __builtin_align_up((u64)min_capacity, (u64)page_size());
+    u8* items = nullptr;
+    if (auto result = mailbox_map_ring(capacity, &items); !result.ok)
+        return result;
+
+    memzero(mb);
+    mb->items = items;
+    mb->capacity = capacity;
+    ty_set_initialized(mb);
+    return kerror_none;
+}
+
+C_API void mpsc_mailbox_deinit(MPSCMailbox* mb)
+{
+    if (!ty_is_initialized(mb)) return;
+    if (mb->items) munmap(mb->items, 2 * mb->capacity);
+    mb->items = nullptr;
+    mb->version = 0;
+}
+
+MPSCMailboxReader* MPSCMailbox::reader(pthread_t thread) { return mpsc_mailbox_reader(this, thread); }
+C_API MPSCMailboxReader* mpsc_mailbox_reader(MPSCMailbox* mb, pthread_t thread)
+{
+    if (mb->reader_thread.is_tied) {
+        VERIFY(pthread_equal(mb->reader_thread.thread, thread));
+    }
+    if (!mb->reader_thread.waker)
+        mb->reader_thread.waker = mailbox_waker_for_thread(thread);
+    mb->reader_thread.thread = thread;
+    mb->reader_thread.is_tied = true;
+    return (MPSCMailboxReader*)mb;
+}
+
+KError MPSCMailbox::post(u16 tag, u64 size, u64 align, void const* data) { return mpsc_mailbox_post(this, tag, size, align, data); }
+C_API KError mpsc_mailbox_post(MPSCMailbox* mb, u16 tag, u64 size, u64 align, void const* data)
+{
+    guard (ty_is_initialized(mb)) else return kerror_unix(EINVAL);
+    guard (size <= message_size_max) else return kerror_unix(EINVAL);
+    guard (align <= message_align_max) else return kerror_unix(EINVAL);
+    guard ((align & (align - 1)) == 0) else return kerror_unix(EINVAL);
+    guard (ty_type_name(tag) && "type has not been ty_type_register()'ed") else return kerror_unix(EINVAL);
+
+    u64 stride = stride_for(size, align);
+    guard (stride < mb->capacity) else return kerror_unix(EMSGSIZE);
+
+    // NOTE: Room is checked against the offset we claim from, so a writer
+    //       that loses the race to a full ring gives up instead of waiting
+    //       for the reader. A failed exchange means another writer got in,
+    //       someone always makes progress.
+    u64 start = __c11_atomic_load(&mb->reserve_offset, __ATOMIC_RELAXED);
+    for (;;) {
+        if (start + stride - mb->read_offset > mb->capacity)
+            return kerror_unix(EWOULDBLOCK);
+        if (__c11_atomic_compare_exchange_weak(&mb->reserve_offset, &start, start + stride, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED))
+            break;
+    }
+
+    Message* m = message_at(mb, start);
+    VERIFY(m->state == MessageState_Empty);
+    m->tag = tag;
+    m->align = (u16)align;
+    m->size = (u32)size;
+    m->stride = (u32)stride;
+    memcpy(message_data(m), data, size);
+    m->state = MessageState_Ready;
+
+    if (mb->reader_thread.is_tied) {
+        mailbox_waker_wake(mb->reader_thread.waker);
+    }
+    return kerror_none;
+}
+
+MailboxStatus MPSCMailboxReader::peek(u16* tag) const { return mpsc_mailbox_peek(this, tag); }
+C_API MailboxStatus mpsc_mailbox_peek(MPSCMailboxReader const* mb, u16* tag)
+{
+    VERIFY(tag != nullptr);
+    auto const* message = read_ptr(&mb->mailbox);
+    if (!message) return mailbox_empty();
+    *tag = message->tag;
+    return mailbox_found();
+}
+
+KError MPSCMailboxReader::read(u16 tag, u64 size, u64 align, void* out) { return mpsc_mailbox_read(this, tag, size, align, out); }
+C_API KError mpsc_mailbox_read(MPSCMailboxReader* mb, u16 tag, u64 size, u64 align, void* out)
+{
+    auto const* message = read_ptr(&mb->mailbox);
+    if (!message)
+        return kerror_unix(ENOENT);
+    if (verify(message->tag == tag).failed)
+        return kerror_unix(EINVAL);
+    if (verify(message->size == size).failed)
+        return kerror_unix(EINVAL);
+    if (verify(message->align == align).failed)
+        return kerror_unix(EINVAL);
+    memcpy(out, message_data(message), size);
+    consume(&mb->mailbox, message);
+    return kerror_none;
+}
+
+void MPSCMailboxReader::toss(u16 tag) { return mpsc_mailbox_toss(this, tag); }
+C_API void mpsc_mailbox_toss(MPSCMailboxReader* mb, u16 tag)
+{
+    auto const* message = read_ptr(&mb->mailbox);
+    if (!message)
+        return;
+    if (verify(message->tag == tag).failed)
+        return;
+    consume(&mb->mailbox, message);
+}
+
+MailboxDidTimeout MPSCMailboxReader::wait(struct timespec const* timeout) { return mpsc_mailbox_wait(this, timeout); }
+C_API MailboxDidTimeout mpsc_mailbox_wait(MPSCMailboxReader* mb, struct timespec const* timeout)
+{
+    VERIFY(mb->mailbox.reader_thread.is_tied);
+    VERIFY(pthread_equal(mb->mailbox.reader_thread.thread, pthread_self()));
+    return mailbox_waker_park_until(mb->mailbox.reader_thread.waker, timeout, is_readable, &mb->mailbox);
+}
+
+static u64 stride_for(u64 size, u64 align)
+{
+    // NOTE: Claimed before the address is known, so reserve for the worst
+    //       case padding between the header and an over-aligned payload.
+    u64 padding = align > message_stride_align ? align - message_stride_align : 0;
+    return __builtin_align_up(sizeof(Message) + padding + size, message_stride_align);
+}
+
+static u8* message_data(Message const* m)
+{
+    u64 align = m->align ? m->align : 1;
+    return (u8*)__builtin_align_up((u8 const*)m->data, align);
+}
+
+static Message* message_at(MPSCMailbox const* mb, u64 offset)
+{
+    return (Message*)(mb->items + (offset % mb->capacity));
+}
+
+static Message const* read_ptr(MPSCMailbox const* mb)
+{
+    VERIFY(mb->reader_thread.is_tied);
+    VERIFY(pthread_equal(mb->reader_thread.thread, pthread_self()));
+    auto const* message = message_at(mb, mb->read_offset);
+    if (message->state != MessageState_Ready)
+        return nullptr;
+    return message;
+}
+
+static void consume(MPSCMailbox* mb, Message const* message)
+{
+    // NOTE: The next lap may put a header anywhere in this range, so all of
+    //       it goes back to zero before writers can claim it.
+    u64 stride = message->stride;
+    memset((void*)message, 0, stride);
+    mb->read_offset += stride;
+}
+
+static bool is_readable(void* user)
+{
+    auto const* mb = (MPSCMailbox const*)user;
+    return message_at(mb, mb->read_offset)->state == MessageState_Ready;
+}
@@ -0,0 +1,74 @@
+#pragma once
+#include "./Base.h"
+
+#include "./Mailbox.h"
+
+#include <pthread.h>
+
+typedef struct MPSCMailbox MPSCMailbox;
+typedef struct MPSCMailboxReader MPSCMailboxReader;
+
+// NOTE: Many writers, one reader, same tagged messages as Mailbox. Writers
+//       claim space with a compare-exchange on reserve_offset and publish
+//       by flipping the message's state, so any thread may post without
+//       being tied. Posting to a full ring fails with EWOULDBLOCK and
+//       reading never loops or blocks, so either side is safe on the audio
+//       thread.
+typedef struct MPSCMailbox {
+    u64 version;
+
+    u8* items;
+    u64 capacity;
+
+    struct {
+        pthread_t thread;
+        bool is_tied;
+        MailboxWaker* waker;
+    } reader_thread;
+
+    alignas(cache_line_size) _Atomic u64 reserve_offset; // Shared by all writers.
+    alignas(cache_line_size) _Atomic u64 read_offset;    // Only written by the reader.
+
+#ifdef __cplusplus
+    MPSCMailboxReader* reader(pthread_t = pthread_self());
+
+    template <typename T>
+        requires (sizeof(T) <= message_size_max) && (alignof(T) <= message_align_max)
+    KError post(T const& value) { return post(Ty2::type_id<T>(), sizeof(T), alignof(T), &value); }
+    KError post(u16 tag, u64 size, u64 align, void const* data);
+#endif
+} MPSCMailbox;
+
+typedef struct MPSCMailboxReader {
+    MPSCMailbox mailbox;
+
+#ifdef __cplusplus
+    MailboxStatus peek(u16* tag) const;
+
+    KError read(u16 tag, u64 size, u64 align, void*);
+
+    template <typename T>
+    KError read(T* out) { return read(Ty2::type_id<T>(), sizeof(T), alignof(T), out); }
+
+    void toss(u16 tag);
+
+    MailboxDidTimeout wait(struct timespec const* timeout = nullptr);
+    MailboxDidTimeout wait(struct timespec const& timeout) { return wait(&timeout); }
+#endif
+} MPSCMailboxReader;
+static_assert(sizeof(MPSCMailboxReader) == sizeof(MPSCMailbox));
+static_assert(OFFSET_OF(MPSCMailboxReader, mailbox) == 0);
+
+C_API KError mpsc_mailbox_init(u32 min_capacity, MPSCMailbox*);
+C_API void mpsc_mailbox_deinit(MPSCMailbox*);
+C_API MPSCMailboxReader* mpsc_mailbox_reader(MPSCMailbox*, pthread_t);
+
+C_API KError mpsc_mailbox_post(MPSCMailbox*, u16 tag, u64 size, u64 align, void const* data);
+#ifndef __cplusplus
+#define mpsc_mailbox_post(mailbox, tag, data) mpsc_mailbox_post(mailbox, tag, sizeof(*data), alignof(__typeof(*data)), data)
+#endif
+
+C_API MailboxStatus mpsc_mailbox_peek(MPSCMailboxReader const*, u16* tag);
+C_API KError mpsc_mailbox_read(MPSCMailboxReader*, u16 tag, u64 size, u64 align, void*);
+C_API void mpsc_mailbox_toss(MPSCMailboxReader*, u16 tag);
+C_API MailboxDidTimeout mpsc_mailbox_wait(MPSCMailboxReader*, struct timespec const* timeout);
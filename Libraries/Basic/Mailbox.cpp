@@ -1,4 +1,5 @@
 #include "./Mailbox.h"
+#include "./MailboxMessage.h"
 
 #include "./Verify.h"
 #include "./PageAllocator.h"
@@ -7,6 +8,7 @@
 #include "./Bits.h"
 #include "./BitSet.h"
 #include "./Error.h"
+#include "./RingBuffer.h"
 
 #include <errno.h>
 #include <string.h>
@@ -16,58 +18,90 @@
 #include <unistd.h>
 #include <sys/time.h>
 #include <signal.h>
+#include <pthread.h>
+
+#include <time.h>
+
+#ifdef __linux__
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#else
+#include <sys/event.h>
+#endif
 
 using nullptr_t = decltype(nullptr);
 TYPE_REGISTER(nullptr_t);
 
-typedef struct [[gnu::packed]] Message {
-    u16 tag;
-    u16 align; static_assert(ty_bits_fitting(message_align_max) <= 16);
-    u32 size; static_assert(ty_bits_fitting(message_size_max) <= 32);
-    u8 data[];
-} Message;
-static_assert(alignof(Message) == 1);
-
 static Message const* read_ptr(Mailbox const*);
 static Message* write_ptr(Mailbox const*);
-static u64 fill_count(Mailbox const*);
-static u64 bytes_left(Mailbox const*);
+static u64 unread_count(Mailbox*);
+static bool has_room(Mailbox*, u64 bytes);
 
-static void increment_read_ptr(Mailbox*, u64);
-static void increment_write_ptr(Mailbox*, u64);
+static void consume(Mailbox*, Message const*);
 
 static KError create_ring_buffer(u64 capacity, u8** out);
 
 static KError init_if_needed(Mailbox*);
 
+static MailboxWaker* waker_for_thread(pthread_t);
+static void waker_wake(MailboxWaker*);
+static void waker_park(MailboxWaker*, u32 sequence, struct timespec const* deadline);
+static MailboxDidTimeout park_until(MailboxWaker*, struct timespec const* timeout, bool(*is_ready)(void*), void* user);
+
+
 KError MailboxWriter::post(u16 tag, u64 size, u64 align, void const* data) { return mailbox_post(this, tag, size, align, data); }
 C_API KError mailbox_post(MailboxWriter* mb, u16 tag, u64 size, u64 align, void const* data)
+{
+    void* payload = nullptr;
+    if (auto result = mailbox_reserve(mb, tag, size, align, &payload); !result.ok)
+        return result;
+    memcpy(payload, data, size);
+    mailbox_commit(mb);
+    return kerror_none;
+}
+
+KError MailboxWriter::reserve(u16 tag, u64 size, u64 align, void** out) { return mailbox_reserve(this, tag, size, align, out); }
+C_API KError mailbox_reserve(MailboxWriter* mb, u16 tag, u64 size, u64 align, void** out)
 {
     guard (size <= message_size_max) else return kerror_unix(EINVAL);
     guard (align <= message_align_max) else return kerror_unix(EINVAL);
+    guard ((align & (align - 1)) == 0) else return kerror_unix(EINVAL);
     guard (ty_type_name(tag) && "type has not been ty_type_register()'ed") else return kerror_unix(EINVAL);
     guard (mb->mailbox.writer_thread.is_tied) else return kerror_unix(EINVAL);
     guard (pthread_equal(mb->mailbox.writer_thread.thread, pthread_self())) else return kerror_unix(EINVAL);
 
     if (auto result = init_if_needed(&mb->mailbox); !result.ok)
         return result;
-    if (bytes_left(&mb->mailbox) == 0) return kerror_unix(EWOULDBLOCK);
-    if (size + sizeof(Message) >= bytes_left(&mb->mailbox))
+    u64 worst_case = sizeof(Message) + (align ? align - 1 : 0) + size + message_stride_align;
+    if (!has_room(&mb->mailbox, worst_case))
         return kerror_unix(EWOULDBLOCK);
 
     Message* m = write_ptr(&mb->mailbox);
     *m = (Message){
         .tag = tag,
         .align = (u16)align,
-        .size = (u16)size,
+        .size = (u32)size,
     };
-    memcpy(m->data, data, size);
-    increment_write_ptr(&mb->mailbox, size);
+    *out = message_data(m);
+    mb->mailbox.write_pending += message_stride(m);
+    return kerror_none;
+}
+
+void MailboxWriter::commit() { return mailbox_commit(this); }
+C_API void mailbox_commit(MailboxWriter* mb)
+{
+    VERIFY(mb->mailbox.writer_thread.is_tied);
+    VERIFY(pthread_equal(mb->mailbox.writer_thread.thread, pthread_self()));
+
+    u64 pending = mb->mailbox.write_pending;
+    if (pending == 0)
+        return;
+    mb->mailbox.write_pending = 0;
+    mb->mailbox.write_offset += pending;
 
     if (mb->mailbox.reader_thread.is_tied) {
-        pthread_kill(mb->mailbox.reader_thread.thread, SIGCONT);
+        waker_wake(mb->mailbox.reader_thread.waker);
     }
-    return kerror_none;
 }
 
 KError MailboxReader::read(u16 tag, u64 size, u64 align, void* out) { return mailbox_read(this, tag, size, align, out); }
@@ -85,37 +119,68 @@ C_API KError mailbox_read(MailboxReader* mb, u16 tag, u64 size, u64 align, void*
         return kerror_unix(EINVAL);
     if (verify(message->align == align).failed)
         return kerror_unix(EINVAL);
-    memcpy(out, message->data, size);
-    increment_read_ptr(&mb->mailbox, size);
+    memcpy(out, message_data(message), size);
+    consume(&mb->mailbox, message);
     return kerror_none;
 }
 
-MailboxStatus MailboxReader::peek(u16* tag) const { return mailbox_peek(this, tag); }
-C_API MailboxStatus mailbox_peek(MailboxReader const* mb, u16* tag)
+MailboxStatus MailboxReader::peek(u16* tag) { return mailbox_peek(this, tag); }
+C_API MailboxStatus mailbox_peek(MailboxReader* mb, u16* tag)
 {
     VERIFY(tag != nullptr);
     VERIFY(mb->mailbox.reader_thread.is_tied);
     VERIFY(pthread_equal(mb->mailbox.reader_thread.thread, pthread_self()));
-    if (fill_count(&mb->mailbox) == 0) return mailbox_empty();
+    if (unread_count(&mb->mailbox) == 0) return mailbox_empty();
     *tag = read_ptr(&mb->mailbox)->tag;
     return mailbox_found();
 }
 
-C_API MailboxStatus MailboxReader::peek(u16 tag, void* out, u64 size, u64 align) const { return mailbox_peek2(this, tag, out, size, align); }
-C_API MailboxStatus mailbox_peek2(MailboxReader const* mb, u16 tag, void* out, u64 size, u64 align)
+C_API MailboxStatus MailboxReader::peek(u16 tag, void* out, u64 size, u64 align) { return mailbox_peek2(this, tag, out, size, align); }
+C_API MailboxStatus mailbox_peek2(MailboxReader* mb, u16 tag, void* out, u64 size, u64 align)
 {
     VERIFY(out != nullptr);
     VERIFY(mb->mailbox.reader_thread.is_tied);
     VERIFY(pthread_equal(mb->mailbox.reader_thread.thread, pthread_self()));
-    if (fill_count(&mb->mailbox) == 0) return mailbox_empty();
+    if (unread_count(&mb->mailbox) == 0) return mailbox_empty();
     auto const* ptr = read_ptr(&mb->mailbox);
     if (ptr->tag != tag) return mailbox_empty();
     VERIFY(align == ptr->align);
     VERIFY(size == ptr->size);
-    memcpy(out, ptr->data, ptr->size);
+    memcpy(out, message_data(ptr), ptr->size);
+    return mailbox_found();
+}
+
+MailboxStatus MailboxReader::peek_span(u16* tag, void const** data, u64* size) { return mailbox_peek_span(this, tag, data, size); }
+C_API MailboxStatus mailbox_peek_span(MailboxReader* mb, u16* tag, void const** data, u64* size)
+{
+    VERIFY(tag != nullptr);
+    VERIFY(data != nullptr);
+    VERIFY(size != nullptr);
+    VERIFY(mb->mailbox.reader_thread.is_tied);
+    VERIFY(pthread_equal(mb->mailbox.reader_thread.thread, pthread_self()));
+    if (unread_count(&mb->mailbox) == 0) return mailbox_empty();
+
+    auto const* message = read_ptr(&mb->mailbox);
+    *tag = message->tag;
+    *data = message_data(message);
+    *size = message->size;
+    mb->mailbox.read_pending += message_stride(message);
     return mailbox_found();
 }
 
+void MailboxReader::release() { return mailbox_release(this); }
+C_API void mailbox_release(MailboxReader* mb)
+{
+    VERIFY(mb->mailbox.reader_thread.is_tied);
+    VERIFY(pthread_equal(mb->mailbox.reader_thread.thread, pthread_self()));
+
+    u64 pending = mb->mailbox.read_pending;
+    if (pending == 0)
+        return;
+    mb->mailbox.read_pending = 0;
+    mb->mailbox.read_offset += pending;
+}
+
 void MailboxReader::toss(u16 tag) { return mailbox_toss(this, tag); }
 C_API void mailbox_toss(MailboxReader* mb, u16 tag)
 {
@@ -129,7 +194,7 @@ C_API void mailbox_toss(MailboxReader* mb, u16 tag)
         return;
 
     Message const* message = read_ptr(&mb->mailbox);
-    increment_read_ptr(&mb->mailbox, message->size);
+    consume(&mb->mailbox, message);
 }
 
 MailboxDidTimeout MailboxReader::wait(struct timespec const* timeout) { return mailbox_wait(this, timeout); }
@@ -138,37 +203,117 @@ C_API MailboxDidTimeout mailbox_wait(MailboxReader* mb, struct timespec const* t
     VERIFY(mb->mailbox.reader_thread.is_tied);
     VERIFY(pthread_equal(mb->mailbox.reader_thread.thread, pthread_self()));
 
-    if (timeout) {
-        int e = nanosleep(timeout, nullptr);
-        return (MailboxDidTimeout){e == 0};
+    return park_until(mb->mailbox.reader_thread.waker, timeout, [](void* user) {
+        return unread_count((Mailbox*)user) != 0;
+    }, &mb->mailbox);
+}
+
+typedef struct {
+    MailboxReader* const* readers;
+    u32 count;
+    u64 ready;
+} ReadyQuery;
+
+static bool query_is_ready(void* user)
+{
+    auto* query = (ReadyQuery*)user;
+    query->ready = mailbox_ready_mask(query->readers, query->count);
+    return query->ready != 0;
+}
+
+C_API u64 mailbox_ready_mask(MailboxReader* const* readers, u32 count)
+{
+    VERIFY(count <= 64);
+    u64 ready = 0;
+    for (u32 i = 0; i < count; i++) {
+        if (readers[i] && unread_count(&readers[i]->mailbox) != 0)
+            ready |= 1ull << i;
     }
+    return ready;
+}
 
-    sigset_t sigs;
-    sigemptyset(&sigs);
-    sigaddset(&sigs, SIGCONT);
-    VERIFY(sigwait(&sigs, nullptr) == 0);
-    return (MailboxDidTimeout){false};
+C_API MailboxDidTimeout mailbox_wait_many(MailboxReader* const* readers, u32 count, u64* ready, struct timespec const* timeout)
+{
+    VERIFY(count <= 64);
+    VERIFY(ready != nullptr);
+
+    // NOTE: All readers belong to this thread, so they share one waker and
+    //       a post to any of them bumps the word we park on.
+    MailboxWaker* waker = nullptr;
+    for (u32 i = 0; i < count; i++) {
+        if (!readers[i]) continue;
+        VERIFY(readers[i]->mailbox.reader_thread.is_tied);
+        VERIFY(pthread_equal(readers[i]->mailbox.reader_thread.thread, pthread_self()));
+        VERIFY(!waker || waker == readers[i]->mailbox.reader_thread.waker);
+        waker = readers[i]->mailbox.reader_thread.waker;
+    }
+    if (!waker) {
+        *ready = 0;
+        return mailbox_wait_any(timeout);
+    }
+
+    ReadyQuery query = {
+        .readers = readers,
+        .count = count,
+        .ready = 0,
+    };
+    auto result = park_until(waker, timeout, query_is_ready, &query);
+    *ready = query.ready;
+    return result;
 }
 
-C_API MailboxDidTimeout mailbox_wait_any(struct timespec const* timeout)
+MailboxReader* MailboxReaderSet::reader(u32 sender) { return mailbox_reader_set_reader(this, sender); }
+C_API MailboxReader* mailbox_reader_set_reader(MailboxReaderSet* set, u32 sender)
 {
-    if (timeout) {
-        int e = nanosleep(timeout, nullptr);
-        return (MailboxDidTimeout){e == 0};
+    VERIFY(sender < mailbox_port_max);
+    auto* mailbox = &set->mailbox[sender];
+    VERIFY(mailbox->reader_thread.is_tied);
+    return (MailboxReader*)mailbox;
+}
+
+u32 MailboxReaderSet::ready() { return mailbox_reader_set_ready(this); }
+C_API u32 mailbox_reader_set_ready(MailboxReaderSet* set)
+{
+    u32 ready = 0;
+    for (u32 i = 0; i < mailbox_port_max; i++) {
+        if (unread_count(&set->mailbox[i]) != 0)
+            ready |= 1u << i;
     }
+    return ready;
+}
 
-    sigset_t sigs;
-    sigemptyset(&sigs);
-    sigaddset(&sigs, SIGCONT);
-    VERIFY(sigwait(&sigs, nullptr) == 0);
-    return (MailboxDidTimeout){false};
+MailboxDidTimeout MailboxReaderSet::wait(u32* ready, struct timespec const* timeout) { return mailbox_reader_set_wait(this, ready, timeout); }
+C_API MailboxDidTimeout mailbox_reader_set_wait(MailboxReaderSet* set, u32* ready, struct timespec const* timeout)
+{
+    MailboxReader* readers[mailbox_port_max];
+    for (u32 i = 0; i < mailbox_port_max; i++)
+        readers[i] = (MailboxReader*)&set->mailbox[i];
+
+    u64 mask = 0;
+    auto result = mailbox_wait_many(readers, mailbox_port_max, &mask, timeout);
+    *ready = (u32)mask;
+    return result;
+}
+
+C_API MailboxDidTimeout mailbox_wait_any(struct timespec const* timeout)
+{
+    static thread_local MailboxWaker* this_thread_waker = nullptr;
+    if (!this_thread_waker)
+        this_thread_waker = waker_for_thread(pthread_self());
+
+    // NOTE: Without a mailbox to check, anything posted since we last woke
+    //       up counts as pending.
+    return park_until(this_thread_waker, timeout, [](void* user) {
+        auto const* waker = (MailboxWaker const*)user;
+        return waker->sequence != waker->observed;
+    }, this_thread_waker);
 }
 
 static Message const* read_ptr(Mailbox const* mb)
 {
     VERIFY(mb->reader_thread.is_tied);
     VERIFY(pthread_equal(mb->reader_thread.thread, pthread_self()));
-    u64 read_offset = mb->read_offset;
+    u64 read_offset = mb->read_offset + mb->read_pending;
     return (Message*)(mb->items + (read_offset % mb->capacity));
 }
 
@@ -176,43 +321,43 @@ static Message* write_ptr(Mailbox const* mb)
 {
     VERIFY(mb->writer_thread.is_tied);
     VERIFY(pthread_equal(mb->writer_thread.thread, pthread_self()));
-    u64 write_offset = mb->write_offset;
+    u64 write_offset = mb->write_offset + mb->write_pending;
     return (Message*)(mb->items + (write_offset % mb->capacity));
 }
 
-static void increment_read_ptr(Mailbox* mb, u64 amount)
+static void consume(Mailbox* mb, Message const* message)
 {
+    // NOTE: Also releases every span peeked before this message.
     VERIFY(mb->reader_thread.is_tied);
     VERIFY(pthread_equal(mb->reader_thread.thread, pthread_self()));
-    mb->read_offset += (amount + sizeof(Message));
-    VERIFY(fill_count(mb) >= 0);
-}
-
-static void increment_write_ptr(Mailbox* mb, u64 amount)
-{
-    VERIFY(mb->writer_thread.is_tied);
-    VERIFY(pthread_equal(mb->writer_thread.thread, pthread_self()));
-    mb->write_offset += (amount + sizeof(Message));
-    VERIFY(fill_count(mb) >= 0);
+    u64 amount = mb->read_pending + message_stride(message);
+    mb->read_pending = 0;
+    mb->read_offset += amount;
 }
 
-static u64 fill_count(Mailbox const* mb)
+static u64 unread_count(Mailbox* mb)
 {
-    // Whichever offset we load first might have a smaller value. So we load
-    // the read_offset first.
-    u64 read_offset = mb->read_offset;
-    u64 write_offset = mb->write_offset;
-    i64 count = (i64)write_offset - (i64)read_offset;
-    VERIFY(count >= 0);
-    i64 capacity = (i64)mb->capacity;
-    VERIFY(capacity >= 0);
-    VERIFY(count <= capacity);
-    return count;
+    // NOTE: Reader only, write_offset is reloaded when the cached copy says
+    //       everything has been read.
+    u64 read_end = mb->read_offset + mb->read_pending;
+    if (mb->cached_write_offset == read_end)
+        mb->cached_write_offset = mb->write_offset;
+    u64 write_offset = mb->cached_write_offset;
+    VERIFY(write_offset >= read_end);
+    VERIFY(write_offset - mb->read_offset <= mb->capacity);
+    return write_offset - read_end;
 }
 
-static u64 bytes_left(Mailbox const* mb)
+static bool has_room(Mailbox* mb, u64 bytes)
 {
-    return mb->capacity - fill_count(mb);
+    // NOTE: Writer only, read_offset is only reloaded when the cached copy
+    //       says there is not enough room.
+    u64 write_end = mb->write_offset + mb->write_pending;
+    if (write_end - mb->cached_read_offset + bytes < mb->capacity)
+        return true;
+    mb->cached_read_offset = mb->read_offset;
+    VERIFY(write_end - mb->cached_read_offset <= mb->capacity);
+    return write_end - mb->cached_read_offset + bytes < mb->capacity;
 }
 
 static inline u64 ceil_f64_to_u64(f64 x)
@@ -234,17 +379,22 @@ C_API KError mailbox_init(u32 min_capacity, Mailbox* mb)
     *mb = (Mailbox){
         .version = sizeof(*mb),
         .items = address,
-        .read_offset = 0u,
-        .write_offset = 0u,
         .capacity = capacity,
         .reader_thread = {
             .thread = 0,
             .is_tied = false,
+            .waker = nullptr,
         },
         .writer_thread = {
             .thread = 0,
             .is_tied = false,
         },
+        .write_offset = 0u,
+        .write_pending = 0,
+        .cached_read_offset = 0,
+        .read_offset = 0u,
+        .read_pending = 0,
+        .cached_write_offset = 0,
     };
     return kerror_none;
 }
@@ -257,17 +407,22 @@ C_API KError mailbox_lazy_init(u32 min_capacity, Mailbox* mb)
     *mb = (Mailbox){
         .version = sizeof(*mb),
         .items = nullptr,
-        .read_offset = 0u,
-        .write_offset = 0u,
         .capacity = capacity,
         .reader_thread = {
             .thread = 0,
             .is_tied = false,
+            .waker = nullptr,
         },
         .writer_thread = {
             .thread = 0,
             .is_tied = false,
         },
+        .write_offset = 0u,
+        .write_pending = 0,
+        .cached_read_offset = 0,
+        .read_offset = 0u,
+        .read_pending = 0,
+        .cached_write_offset = 0,
     };
     return kerror_none;
 }
@@ -280,6 +435,8 @@ C_API MailboxReader* mailbox_reader(Mailbox* mailbox, pthread_t thread)
     if (mailbox->reader_thread.is_tied) {
         VERIFY(pthread_equal(mailbox->reader_thread.thread, thread));
     }
+    if (!mailbox->reader_thread.waker)
+        mailbox->reader_thread.waker = waker_for_thread(thread);
     mailbox->reader_thread.is_tied = true;
     mailbox->reader_thread.thread = thread;
     return (MailboxReader*)mailbox;
@@ -390,6 +547,19 @@ static bool find_writer_for_receiver(MailboxPorts const* ports, MailboxPort rece
     return false;
 }
 
+C_API MailboxWaker* mailbox_waker_for_thread(pthread_t thread) { return waker_for_thread(thread); }
+C_API void mailbox_waker_wake(MailboxWaker* waker) { return waker_wake(waker); }
+C_API MailboxDidTimeout mailbox_waker_park_until(MailboxWaker* waker, struct timespec const* timeout, bool(*is_ready)(void*), void* user)
+{
+    return park_until(waker, timeout, is_ready, user);
+}
+
+C_API KError mailbox_map_ring(u64 capacity, u8** out)
+{
+    if (verify(capacity != 0 && capacity % page_size() == 0).failed) return kerror_unix(EINVAL);
+    return create_ring_buffer(capacity, out);
+}
+
 static KError init_if_needed(Mailbox* mb)
 {
     VERIFY(ty_is_initialized(mb));
@@ -401,46 +571,148 @@ static KError init_if_needed(Mailbox* mb)
     return kerror_none; 
 }
 
-static KError create_ring_buffer(u64 capacity, u8** out)
+// NOTE: One waker per live thread that reads from a queue. The slot is
+//       given back when its thread exits, the kqueue stays open for the
+//       next thread that takes it. Queues left tied to a thread that exited
+//       can still bump a recycled waker, which only costs its new owner a
+//       spurious wakeup.
+static MailboxWaker wakers[mailbox_waker_max];
+static bool waker_in_use[mailbox_waker_max];
+static u32 waker_count = 0;
+static pthread_mutex_t waker_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t waker_key_once = PTHREAD_ONCE_INIT;
+static pthread_key_t waker_key;
+static thread_local MailboxWaker* t_owned_waker = nullptr;
+
+static void release_waker(void* value)
 {
-    VERIFY(capacity == ceil_f64_to_u64((f64)capacity / (f64)page_size()) * page_size());
+    auto* waker = (MailboxWaker*)value;
+    t_owned_waker = nullptr;
+
+    pthread_mutex_lock(&waker_lock);
+    defer [&] { pthread_mutex_unlock(&waker_lock); };
+    waker->parked = 0;
+    waker->observed = waker->sequence;
+    waker_in_use[waker - wakers] = false;
+}
 
-    char shm_path[] = "/dev/shm/ty2-mailbox-XXXXXX";
-    char tmp_path[] = "/tmp/ty2-mailbox-XXXXXX";
-
-    char* chosen_path = shm_path;
-    int fd = mkstemp(shm_path);
-    if (fd < 0) {
-        fd = mkstemp(tmp_path);
-        if (fd < 0) return kerror_unix(errno);
-        chosen_path = tmp_path;
-    } 
-    defer [&] { close(fd); };
-
-    if (unlink(chosen_path))
-        return kerror_unix(errno);
-
-    if (ftruncate(fd, (off_t)capacity))
-        return kerror_unix(errno);
-
-    u8* address = (u8*)mmap(NULL, capacity * 2, PROT_NONE, MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
-    if (address == MAP_FAILED)
-        return kerror_unix(errno);
-    Defer unmap_address = [&]{
-        munmap(address, 2 * capacity);
-    };
+static void create_waker_key(void)
+{
+    VERIFY(pthread_key_create(&waker_key, release_waker) == 0);
+}
 
-    u8* other_address = (u8*)mmap(address, capacity, PROT_READ|PROT_WRITE,
-            MAP_FIXED|MAP_SHARED, fd, 0);
-    if (other_address != address)
-        return kerror_unix(errno);
+// NOTE: Wakers can be handed out on behalf of another thread, so the exit
+//       hook is set by the owner itself, when it creates or first parks on it.
+static void own_waker(MailboxWaker* waker)
+{
+    if (t_owned_waker == waker)
+        return;
+    t_owned_waker = waker;
+    pthread_once(&waker_key_once, create_waker_key);
+    VERIFY(pthread_setspecific(waker_key, waker) == 0);
+}
 
-    other_address = (u8*)mmap(address + capacity, capacity,
-            PROT_READ|PROT_WRITE, MAP_FIXED|MAP_SHARED, fd, 0);
-    if (other_address != address + capacity)
-        return kerror_unix(errno);
+static MailboxWaker* waker_for_thread(pthread_t thread)
+{
+    MailboxWaker* waker = nullptr;
+    {
+        pthread_mutex_lock(&waker_lock);
+        defer [&] { pthread_mutex_unlock(&waker_lock); };
+
+        u32 free_slot = waker_count;
+        for (u32 i = 0; i < waker_count && !waker; i++) {
+            if (!waker_in_use[i]) {
+                if (free_slot == waker_count) free_slot = i;
+                continue;
+            }
+            if (pthread_equal(wakers[i].thread, thread))
+                waker = &wakers[i];
+        }
+        if (!waker) {
+            if (free_slot == waker_count) {
+                VERIFY(waker_count < mailbox_waker_max);
+                waker_count += 1;
+#ifndef __linux__
+                wakers[free_slot].kq = kqueue();
+                VERIFY(wakers[free_slot].kq >= 0);
+                struct kevent event;
+                EV_SET(&event, 1, EVFILT_USER, EV_ADD | EV_CLEAR, 0, 0, nullptr);
+                VERIFY(kevent(wakers[free_slot].kq, &event, 1, nullptr, 0, nullptr) == 0);
+#endif
+            }
+            waker = &wakers[free_slot];
+            waker->thread = thread;
+            waker_in_use[free_slot] = true;
+        }
+    }
+    if (pthread_equal(thread, pthread_self()))
+        own_waker(waker);
+    return waker;
+}
 
-    unmap_address.disarm();
-    *out = address;
-    return kerror_none;
+static void waker_wake(MailboxWaker* waker)
+{
+    VERIFY(waker != nullptr);
+    waker->sequence += 1;
+    if (!waker->parked)
+        return;
+#ifdef __linux__
+    syscall(SYS_futex, &waker->sequence, FUTEX_WAKE_PRIVATE, 1, nullptr, nullptr, 0);
+#else
+    struct kevent event;
+    EV_SET(&event, 1, EVFILT_USER, 0, NOTE_TRIGGER, 0, nullptr);
+    kevent(waker->kq, &event, 1, nullptr, 0, nullptr);
+#endif
+}
+
+static void waker_park(MailboxWaker* waker, u32 sequence, struct timespec const* deadline)
+{
+    // NOTE: Spurious returns and EINTR are fine, park_until rechecks.
+#ifdef __linux__
+    syscall(SYS_futex, &waker->sequence, FUTEX_WAIT_BITSET_PRIVATE, sequence, deadline, nullptr, FUTEX_BITSET_MATCH_ANY);
+#else
+    (void)sequence;
+    struct timespec remaining;
+    if (deadline) {
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        i64 ns = (i64)(deadline->tv_sec - now.tv_sec) * 1000000000 + (i64)(deadline->tv_nsec - now.tv_nsec);
+        if (ns < 0) ns = 0;
+        remaining = (struct timespec){ .tv_sec = ns / 1000000000, .tv_nsec = ns % 1000000000 };
+    }
+    struct kevent event;
+    kevent(waker->kq, nullptr, 0, &event, 1, deadline ? &remaining : nullptr);
+#endif
+}
+
+static MailboxDidTimeout park_until(MailboxWaker* waker, struct timespec const* timeout, bool(*is_ready)(void*), void* user)
+{
+    own_waker(waker);
+
+    struct timespec deadline = {};
+    if (timeout)
+        deadline = deadline_after(timeout);
+
+    // NOTE: The sequence is sampled before the readiness check, so a post
+    //       racing with us either shows up in is_ready or changes the
+    //       sequence and the park returns immediately.
+    for (;;) {
+        u32 sequence = waker->sequence;
+        if (is_ready(user))
+            break;
+        if (timeout && deadline_has_passed(&deadline))
+            return (MailboxDidTimeout){true};
+        waker->parked = 1;
+        if (!is_ready(user))
+            waker_park(waker, sequence, timeout ? &deadline : nullptr);
+        waker->parked = 0;
+    }
+    waker->observed = waker->sequence;
+    return (MailboxDidTimeout){false};
+}
+
+static KError create_ring_buffer(u64 capacity, u8** out)
+{
+    VERIFY(capacity == ceil_f64_to_u64((f64)capacity / (f64)page_size()) * page_size());
+    return ring_buffer_map(capacity, out);
 }
@@ -30,24 +30,47 @@ typedef struct MailboxWriter MailboxWriter;
 
 typedef struct { bool did_timeout; } MailboxDidTimeout;
 
+constexpr u64 mailbox_waker_max = 128; // Threads waiting on queues at the same time.
+
+// NOTE: One per reader thread, shared by every mailbox that thread reads
+//       from. Writers bump sequence on each post but only make a syscall
+//       when the reader is parked, so bursts coalesce into one wakeup.
+//       Timed waits park until the post or the deadline, not the full timeout.
+typedef struct MailboxWaker {
+    _Atomic u32 sequence; // Futex word on Linux.
+    _Atomic u32 parked;
+    u32 observed; // Last sequence the reader woke up to, only touched by the reader.
+    int kq;       // EVFILT_USER wakeups where there is no futex.
+    pthread_t thread;
+} MailboxWaker;
+
 struct timespec;
 typedef struct Mailbox {
     u64 version;
 
     u8* items;
-    _Atomic u64 read_offset;
-    _Atomic u64 write_offset;
     u64 capacity;
 
     struct {
         pthread_t thread;
         bool is_tied;
+        MailboxWaker* waker;
     } reader_thread;
     struct {
         pthread_t thread;
         bool is_tied;
     } writer_thread;
 
+    // NOTE: Each side owns a cache line and keeps a copy of the other side's
+    //       offset, which it only reloads when the ring looks full or empty.
+    alignas(cache_line_size) _Atomic u64 write_offset;
+    u64 write_pending;      // Reserved but not committed yet, writer only.
+    u64 cached_read_offset; // Writer only.
+
+    alignas(cache_line_size) _Atomic u64 read_offset;
+    u64 read_pending;        // Peeked in place but not released yet, reader only.
+    u64 cached_write_offset; // Reader only.
+
 #ifdef __cplusplus
     MailboxReader* reader(pthread_t = pthread_self());
     MailboxWriter* writer(pthread_t = pthread_self());
@@ -55,17 +78,20 @@ typedef struct Mailbox {
     void attach_memory_poker(MemoryPoker*) const;
 #endif
 } Mailbox;
+// NOTE: Shared fields, then one line per side. Keep the shared part within
+//       a line, MailboxPorts holds mailbox_port_max^2 of these.
+static_assert(sizeof(Mailbox) == 3 * cache_line_size);
 
 typedef struct MailboxReader {
     Mailbox mailbox;
 
 #ifdef __cplusplus
-    MailboxStatus peek(u16* tag) const;
+    MailboxStatus peek(u16* tag);
 
     template <typename T>
-    MailboxStatus peek(T* buf) const { return peek(Ty2::type_id<T>(), buf, sizeof(T), alignof(T)); }
+    MailboxStatus peek(T* buf) { return peek(Ty2::type_id<T>(), buf, sizeof(T), alignof(T)); }
 
-    MailboxStatus peek(u16 tag, void*, u64 size, u64 align) const;
+    MailboxStatus peek(u16 tag, void*, u64 size, u64 align);
 
     KError read(u16 tag, u64 size, u64 align, void*);
 
@@ -74,6 +100,11 @@ typedef struct MailboxReader {
 
     void toss(u16 tag);
 
+    // NOTE: Zero copy reads. Spans stay valid until release(), which hands
+    //       all of them back with one store. read() and toss() release too.
+    MailboxStatus peek_span(u16* tag, void const** data, u64* size);
+    void release();
+
     MailboxDidTimeout wait(struct timespec const* timeout = nullptr);
     MailboxDidTimeout wait(struct timespec const& timeout) { return wait(&timeout); }
 #endif
@@ -89,6 +120,15 @@ typedef struct MailboxWriter {
         requires (sizeof(T) <= message_size_max) && (alignof(T) <= message_align_max)
     KError post(T const& value) { return post(Ty2::type_id<T>(), sizeof(T), alignof(T), &value); }
     KError post(u16 tag, u64 size, u64 align, void const* data);
+
+    // NOTE: Zero copy writes. Reserved messages become visible together on
+    //       commit(), with one publish and at most one wakeup. post() commits
+    //       everything reserved before it as well.
+    template <typename T>
+        requires (sizeof(T) <= message_size_max) && (alignof(T) <= message_align_max)
+    KError reserve(T** out) { return reserve(Ty2::type_id<T>(), sizeof(T), alignof(T), (void**)out); }
+    KError reserve(u16 tag, u64 size, u64 align, void** out);
+    void commit();
 #endif
 } MailboxWriter;
 static_assert(sizeof(MailboxWriter) == sizeof(Mailbox));
@@ -96,7 +136,22 @@ static_assert(OFFSET_OF(MailboxWriter, mailbox) == 0);
 
 typedef struct MailboxPort { u64 id; } MailboxPort;
 
-typedef struct MailboxReaderSet MailboxReaderSet;
+// NOTE: One receiver port's row of MailboxPorts, a mailbox per sender.
+//       Ready sets are bitmasks indexed by sender.
+typedef struct MailboxReaderSet {
+    Mailbox mailbox[mailbox_port_max];
+
+#ifdef __cplusplus
+    MailboxReader* reader(u32 sender);
+    u32 ready();
+
+    MailboxDidTimeout wait(u32* ready, struct timespec const* timeout = nullptr);
+    MailboxDidTimeout wait(u32* ready, struct timespec const& timeout) { return wait(ready, &timeout); }
+#endif
+} MailboxReaderSet;
+static_assert(sizeof(MailboxReaderSet) == sizeof(Mailbox) * mailbox_port_max);
+static_assert(mailbox_port_max <= 32);
+
 typedef struct MailboxPorts {
     Mailbox mailbox[mailbox_port_max][mailbox_port_max]; // receiver port, sender
     pthread_t sender[mailbox_port_max][mailbox_port_max]; // receiver port, sender
@@ -115,7 +170,9 @@ typedef struct MailboxPorts {
     MailboxWriter* writer(MailboxPort receiver, pthread_t = pthread_self());
 #endif
 } MailboxPorts;
-static_assert(sizeof(MailboxPorts) < 96 * KiB);
+// NOTE: 192 KiB of mailboxes with 64 byte lines, 384 KiB with the 128 byte
+//       lines of Apple arm64, everything else fits in the slack.
+static_assert(sizeof(MailboxPorts) < sizeof(Mailbox) * mailbox_port_max * mailbox_port_max + 16 * KiB);
 
 C_API KError mailbox_init(u32 min_capacity, Mailbox*);
 C_API KError mailbox_lazy_init(u32 min_capacity, Mailbox*);
@@ -133,13 +190,27 @@ C_API KError mailbox_post(MailboxWriter*, u16 tag, u64 size, u64 align, void con
 #define mailbox_post(writer, tag, data) mailbox_post(writer, tag, sizeof(*data), alignof(__typeof(*data)), data)
 #endif
 
+C_API KError mailbox_reserve(MailboxWriter*, u16 tag, u64 size, u64 align, void** out);
+C_API void mailbox_commit(MailboxWriter*);
+
 C_API KError mailbox_read(MailboxReader*, u16 tag, u64 size, u64 align, void*);
-C_API MailboxStatus mailbox_peek(MailboxReader const*, u16* tag);
-C_API MailboxStatus mailbox_peek2(MailboxReader const*, u16 tag, void*, u64 size, u64 align);
+C_API MailboxStatus mailbox_peek(MailboxReader*, u16* tag);
+C_API MailboxStatus mailbox_peek2(MailboxReader*, u16 tag, void*, u64 size, u64 align);
 C_API void mailbox_toss(MailboxReader*, u16 tag);
+C_API MailboxStatus mailbox_peek_span(MailboxReader*, u16* tag, void const** data, u64* size);
+C_API void mailbox_release(MailboxReader*);
 C_API MailboxDidTimeout mailbox_wait(MailboxReader*, struct timespec const* timeout);
 
 C_API MailboxDidTimeout mailbox_wait_any(struct timespec const* timeout);
+
+// NOTE: Parks once for up to 64 readers tied to the calling thread, ready
+//       gets bit i set for every readers[i] holding a message.
+C_API u64 mailbox_ready_mask(MailboxReader* const*, u32 count);
+C_API MailboxDidTimeout mailbox_wait_many(MailboxReader* const*, u32 count, u64* ready, struct timespec const* timeout);
+
+C_API MailboxReader* mailbox_reader_set_reader(MailboxReaderSet*, u32 sender);
+C_API u32 mailbox_reader_set_ready(MailboxReaderSet*);
+C_API MailboxDidTimeout mailbox_reader_set_wait(MailboxReaderSet*, u32* ready, struct timespec const* timeout);
 #ifdef __cplusplus
 static inline MailboxDidTimeout mailbox_wait_any(struct timespec const& timeout) { return mailbox_wait_any(&timeout); }
 static inline MailboxDidTimeout mailbox_wait_any() { return mailbox_wait_any(nullptr); }
@@ -150,3 +221,10 @@ C_API KError mailbox_ports_reserve_port(MailboxPorts*, MailboxPort* out, u64 min
 C_API KError mailbox_ports_reserve_important_port(MailboxPorts*, MailboxPort* out, u64 min_capacity);
 C_API MailboxReaderSet* mailbox_ports_reader(MailboxPorts*, MailboxPort reader, pthread_t);
 C_API MailboxWriter* mailbox_ports_writer(MailboxPorts*, MailboxPort receiver, pthread_t);
+
+// NOTE: Shared with the other queues in Basic, so every consumer thread
+//       parks on the same waker no matter what kind of queue it reads.
+C_API MailboxWaker* mailbox_waker_for_thread(pthread_t);
+C_API void mailbox_waker_wake(MailboxWaker*);
+C_API MailboxDidTimeout mailbox_waker_park_until(MailboxWaker*, struct timespec const* timeout, bool(*is_ready)(void*), void* user);
+C_API KError mailbox_map_ring(u64 capacity, u8** out); // capacity must be page aligned, mapped twice back to back.
@@ -0,0 +1,56 @@
+#pragma once
+#include "./Mailbox.h"
+
+#include <time.h>
+
+// NOTE: Message framing and deadline helpers shared by Mailbox and
+//       SharedMailbox. Not exported, SharedMailbox puts this layout on the
+//       wire between processes, so both ends are built from this header.
+
+typedef struct [[gnu::packed]] Message {
+    u16 tag;
+    u16 align; static_assert(ty_bits_fitting(message_align_max) <= 16);
+    u32 size; static_assert(ty_bits_fitting(message_size_max) <= 32);
+    u8 data[];
+} Message;
+static_assert(alignof(Message) == 1);
+static_assert(sizeof(Message) == 8);
+
+// NOTE: Messages start on this alignment, payloads are padded up to their
+//       own alignment after the header so they can be used in place.
+constexpr u64 message_stride_align = 8;
+static_assert(sizeof(Message) % message_stride_align == 0);
+
+static inline u8* message_data(Message const* m)
+{
+    u64 align = m->align ? m->align : 1;
+    return (u8*)__builtin_align_up((u8 const*)m->data, align);
+}
+
+static inline u64 message_stride(Message const* m)
+{
+    u8 const* end = message_data(m) + m->size;
+    return (u64)((u8 const*)__builtin_align_up(end, message_stride_align) - (u8 const*)m);
+}
+
+// NOTE: Deadlines are CLOCK_MONOTONIC, which is also what the futex waits
+//       measure absolute timeouts against.
+static inline struct timespec deadline_after(struct timespec const* timeout)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    i64 ns = (i64)now.tv_nsec + (i64)timeout->tv_nsec;
+    return (struct timespec){
+        .tv_sec = now.tv_sec + timeout->tv_sec + (time_t)(ns / 1000000000),
+        .tv_nsec = (long)(ns % 1000000000),
+    };
+}
+
+static inline bool deadline_has_passed(struct timespec const* deadline)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    if (now.tv_sec != deadline->tv_sec)
+        return now.tv_sec > deadline->tv_sec;
+    return now.tv_nsec >= deadline->tv_nsec;
+}
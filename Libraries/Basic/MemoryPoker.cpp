@@ -7,6 +7,19 @@
 #include "./Context.h"
 
 #include <pthread.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <errno.h>
+
+#ifdef __linux__
+#include <sys/syscall.h>
+#ifndef MLOCK_ONFAULT
+#define MLOCK_ONFAULT 0x01
+#endif
+#ifndef MADV_POPULATE_WRITE
+#define MADV_POPULATE_WRITE 23
+#endif
+#endif
 
 static consteval struct timespec operator ""_ms(unsigned long long value)
 {
@@ -27,6 +40,7 @@ static consteval struct timespec operator ""_ms(unsigned long long value)
 }
 
 static void* poker_thread(void*);
+static bool prefault_and_lock(u8 const* start, u64 size);
 
 C_API void memory_poker_init(MemoryPoker* poker)
 {
@@ -49,19 +63,97 @@ void MemoryPoker::push(void const* memory, u64 size) { return memory_poker_push(
 C_API void memory_poker_push(MemoryPoker* poker, void const* memory, u64 size)
 {
     u64 page_size = ::page_size();
-    u64 start = ((u64)(uptr)memory) & ~page_size;
-    u64 page_count = size / page_size;
+    u64 start = ((u64)(uptr)memory) & ~(page_size - 1);
+    u64 end = __builtin_align_up((u64)(uptr)memory + size, page_size);
+    u64 page_count = (end - start) / page_size;
     u32 truncated_page_count = page_count;
     VERIFY(page_count == truncated_page_count);
 
     u64 new_count = poker->count + 1;
     VERIFY(new_count < memory_poker_ranges_max);
     u64 id = new_count - 1;
+
+    MemoryFaultCount before = memory_fault_count_thread();
+    bool is_locked = prefault_and_lock((u8 const*)(uptr)start, end - start);
+    MemoryFaultCount after = memory_fault_count_thread();
+
     poker->pages[id] = (u8 const*)(uptr)start;
     poker->page_counts[id] = page_count;
+    poker->is_locked[id] = is_locked;
+    poker->prefault_faults[id] = (MemoryFaultCount){
+        .minor = after.minor - before.minor,
+        .major = after.major - before.major,
+    };
     poker->count = new_count;
 }
 
+MemoryPokerRangeStats MemoryPoker::range_stats(u64 index) const { return memory_poker_range_stats(this, index); }
+C_API MemoryPokerRangeStats memory_poker_range_stats(MemoryPoker const* poker, u64 index)
+{
+    VERIFY(index < poker->count);
+    u64 page_size = ::page_size();
+    u8 const* start = (u8 const*)poker->pages[index];
+    u64 page_count = poker->page_counts[index];
+
+    u64 resident = 0;
+#ifdef __APPLE__
+    char residency[256];
+#else
+    unsigned char residency[256];
+#endif
+    for (u64 page = 0; page < page_count; page += sizeof(residency)) {
+        u64 chunk = page_count - page < sizeof(residency) ? page_count - page : sizeof(residency);
+        if (mincore((void*)(start + page * page_size), chunk * page_size, residency) < 0)
+            break;
+        for (u64 i = 0; i < chunk; i++)
+            resident += residency[i] & 1;
+    }
+
+    return (MemoryPokerRangeStats){
+        .page_count = page_count,
+        .resident_pages = resident,
+        .prefault = poker->prefault_faults[index],
+        .is_locked = poker->is_locked[index],
+    };
+}
+
+C_API MemoryFaultCount memory_fault_count_thread(void)
+{
+    struct rusage usage;
+#ifdef __linux__
+    if (getrusage(RUSAGE_THREAD, &usage) < 0)
+        return (MemoryFaultCount){};
+#else
+    if (getrusage(RUSAGE_SELF, &usage) < 0)
+        return (MemoryFaultCount){};
+#endif
+    return (MemoryFaultCount){
+        .minor = (u64)usage.ru_minflt,
+        .major = (u64)usage.ru_majflt,
+    };
+}
+
+static bool prefault_and_lock(u8 const* start, u64 size)
+{
+#ifdef __linux__
+    // NOTE: Lock on fault first, then populate for writing, so pages come
+    //       in writable (no copy on write fault later) and stay in. Kernels
+    //       before 5.14 have no MADV_POPULATE_WRITE, plain mlock() faults
+    //       the range in by itself there.
+    if (syscall(SYS_mlock2, start, size, MLOCK_ONFAULT) == 0) {
+        if (madvise((void*)start, size, MADV_POPULATE_WRITE) == 0)
+            return true;
+        munlock(start, size);
+    }
+    if (mlock(start, size) == 0)
+        return true;
+    (void)madvise((void*)start, size, MADV_POPULATE_WRITE);
+    return false;
+#else
+    return mlock(start, size) == 0;
+#endif
+}
+
 [[clang::no_sanitize("address")]]
 static void* poker_thread(void* user)
 {
@@ -73,11 +165,13 @@ static void* poker_thread(void* user)
         reset_temporary_arena();
         u64 count = poker->count;
         for (u64 i = 0; i < count; i++) {
+            if (poker->is_locked[i])
+                continue;
             u8 volatile const* start = poker->pages[i];
             u64 page_count = poker->page_counts[i];
 
             for (u64 page = 0; page < page_count; page++)
-                start[(page + 1) * page_size];
+                start[page * page_size];
         }
 
         auto interval = 1000_ms;
@@ -2,7 +2,24 @@
 #include "./Base.h"
 #include "./Bits.h"
 
+typedef struct MemoryFaultCount {
+    u64 minor;
+    u64 major;
+} MemoryFaultCount;
+
+// NOTE: A snapshot, not a running count. Faults taken on the range after
+//       push() are not tracked per range.
+typedef struct MemoryPokerRangeStats {
+    u64 page_count;
+    u64 resident_pages; // Sampled with mincore() when asked.
+    MemoryFaultCount prefault; // Faults taken by push() to bring the range in, once.
+    bool is_locked;
+} MemoryPokerRangeStats;
+
 // NOTE: Only thread safe for single consumer single producer
+//       push() prefaults and locks the range once. Ranges that can not be
+//       locked (RLIMIT_MEMLOCK, no CAP_IPC_LOCK) are kept warm by the poker
+//       thread touching them every second instead.
 constexpr u64 memory_poker_ranges_max = 128LLU;
 typedef struct MemoryPoker {
     u64 version;
@@ -10,15 +27,25 @@ typedef struct MemoryPoker {
     _Atomic u64 count;
     u8 volatile const* pages[memory_poker_ranges_max];
     u32 page_counts[memory_poker_ranges_max];
+    bool is_locked[memory_poker_ranges_max];
+    MemoryFaultCount prefault_faults[memory_poker_ranges_max];
 
 #if __cplusplus
     void push(void const*, u64);
 
     [[nodiscard]] bool start();
+
+    MemoryPokerRangeStats range_stats(u64 index) const;
 #endif
 } MemoryPoker;
-static_assert(sizeof(MemoryPoker) < 2 * KiB);
+static_assert(sizeof(MemoryPoker) < 4 * KiB);
 
 C_API void memory_poker_init(MemoryPoker*);
 C_API void memory_poker_push(MemoryPoker*, void const*, u64);
 C_API [[nodiscard]] bool memory_poker_start(MemoryPoker*);
+C_API MemoryPokerRangeStats memory_poker_range_stats(MemoryPoker const*, u64 index);
+
+// NOTE: Faults taken by the calling thread so far. Only Linux counts per
+//       thread, elsewhere this is the whole process and useless around a
+//       real time callback.
+C_API MemoryFaultCount memory_fault_count_thread(void);
@@ -0,0 +1,248 @@
+#include "./ObjectPool.h"
+
+#include "./Verify.h"
+#include "./PageAllocator.h"
+
+#include <errno.h>
+#include <pthread.h>
+
+static void* dispatch(Allocator*, AllocatorEvent);
+
+static ObjectPoolCache* thread_cache(ObjectPool*);
+static u32 claim_slot(void);
+static void release_slot(void*);
+static void create_slot_key(void);
+static u32 pop_global(ObjectPool*);
+static void push_global(ObjectPool*, u32 const* items, u32 count);
+static u32* next_of(ObjectPool const*, u32 item);
+static void* object_at(ObjectPool const*, u32 item);
+static u32 item_of(ObjectPool const*, void const*);
+static u64 backing_size(ObjectPool const*);
+
+C_API KError object_pool_init(ObjectPool* pool, u64 object_size, u64 object_align, u32 capacity)
+{
+    if (!C_ASSERT(!ty_is_initialized(pool))) return kerror_unix(EINVAL);
+    if (!C_ASSERT(object_size != 0)) return kerror_unix(EINVAL);
+    if (!C_ASSERT(object_align != 0 && (object_align & (object_align - 1)) == 0)) return kerror_unix(EINVAL);
+    if (!C_ASSERT(object_align <= page_size())) return kerror_unix(EINVAL);
+    if (!C_ASSERT(capacity != 0 && capacity < 0xFFFFFFFF)) return kerror_unix(EINVAL);
+
+    // NOTE: Free objects hold the next link in their first four bytes.
+    u64 stride = __builtin_align_up(object_size < sizeof(u32) ? sizeof(u32) : object_size, object_align < alignof(u32) ? alignof(u32) : object_align);
+
+    memzero(pool);
+    pool->allocator = allocator_init(dispatch);
+    pool->stride = stride;
+    pool->object_size = object_size;
+    pool->object_align = object_align;
+    pool->capacity = capacity;
+
+    pool->objects = (u8*)page_alloc(backing_size(pool));
+    if (!pool->objects) {
+        memzero(pool);
+        return kerror_unix(ENOMEM);
+    }
+
+    ty_set_initialized(pool);
+    return kerror_none;
+}
+
+C_API void object_pool_deinit(ObjectPool* pool)
+{
+    if (!ty_is_initialized(pool)) return;
+    page_free(pool->objects, backing_size(pool));
+    memzero(pool);
+}
+
+void* ObjectPool::alloc() { return object_pool_alloc(this); }
+C_API void* object_pool_alloc(ObjectPool* pool)
+{
+    if (!C_ASSERT(ty_is_initialized(pool))) return nullptr;
+
+    ObjectPoolCache* cache = thread_cache(pool);
+    if (cache && cache->count > 0)
+        return object_at(pool, cache->items[--cache->count]);
+
+    u32 item = pop_global(pool);
+    if (item == 0) {
+        u32 fresh = (pool->fresh_count += 1) - 1;
+        if (fresh >= pool->capacity) {
+            pool->fresh_count -= 1;
+            return nullptr;
+        }
+        item = fresh + 1;
+    }
+
+    // NOTE: Refill half the cache while we are at the global list anyway,
+    //       so the next few allocations on this thread stay local.
+    if (cache) {
+        while (cache->count < object_pool_cache_size / 2) {
+            u32 extra = pop_global(pool);
+            if (extra == 0) break;
+            cache->items[cache->count++] = extra;
+        }
+    }
+    return object_at(pool, item);
+}
+
+void ObjectPool::free(void* ptr) { return object_pool_free(this, ptr); }
+C_API void object_pool_free(ObjectPool* pool, void* ptr)
+{
+    if (!ptr) return;
+    VERIFY(object_pool_owns(pool, ptr));
+    u32 item = item_of(pool, ptr);
+
+    ObjectPoolCache* cache = thread_cache(pool);
+    if (!cache) {
+        push_global(pool, &item, 1);
+        return;
+    }
+
+    if (cache->count == object_pool_cache_size) {
+        u32 half = object_pool_cache_size / 2;
+        push_global(pool, &cache->items[half], object_pool_cache_size - half);
+        cache->count = half;
+    }
+    cache->items[cache->count++] = item;
+}
+
+bool ObjectPool::owns(void const* ptr) const { return object_pool_owns(this, ptr); }
+C_API bool object_pool_owns(ObjectPool const* pool, void const* ptr)
+{
+    u8 const* p = (u8 const*)ptr;
+    if (p < pool->objects || p >= pool->objects + (u64)pool->capacity * pool->stride)
+        return false;
+    return (u64)(p - pool->objects) % pool->stride == 0;
+}
+
+void ObjectPool::flush_thread_cache() { return object_pool_flush_thread_cache(this); }
+C_API void object_pool_flush_thread_cache(ObjectPool* pool)
+{
+    ObjectPoolCache* cache = thread_cache(pool);
+    if (!cache || cache->count == 0) return;
+    push_global(pool, cache->items, cache->count);
+    cache->count = 0;
+}
+
+// NOTE: Slots are shared by all pools, a thread gets the same cache index
+//       in every pool. A slot is given back when its thread exits, the
+//       objects still cached under it go to whichever thread claims it next.
+static_assert(object_pool_thread_max <= 64);
+static constexpr u32 slot_none = 0xFFFFFFFF;
+static constexpr u64 slot_mask = object_pool_thread_max == 64 ? ~0ull : (1ull << (object_pool_thread_max % 64)) - 1;
+static _Atomic u64 slots_in_use = 0;
+static pthread_once_t slot_key_once = PTHREAD_ONCE_INIT;
+static pthread_key_t slot_key;
+static thread_local u32 t_slot = slot_none;
+
+static ObjectPoolCache* thread_cache(ObjectPool* pool)
+{
+    // NOTE: Threads that found every slot taken try again on later calls,
+    //       that is one load while the slots stay full.
+    if (t_slot == slot_none) {
+        t_slot = claim_slot();
+        if (t_slot == slot_none)
+            return nullptr;
+        pthread_once(&slot_key_once, create_slot_key);
+        pthread_setspecific(slot_key, (void*)(uptr)(t_slot + 1));
+    }
+    return &pool->caches[t_slot];
+}
+
+static u32 claim_slot(void)
+{
+    u64 used = __c11_atomic_load(&slots_in_use, __ATOMIC_RELAXED);
+    for (;;) {
+        u64 free_slots = ~used & slot_mask;
+        if (free_slots == 0)
+            return slot_none;
+        u32 slot = (u32)__builtin_ctzll(free_slots);
+        // NOTE: Acquire pairs with the release in release_slot(), the cached
+        //       items the last owner left behind are visible from here on.
+        if (__c11_atomic_compare_exchange_weak(&slots_in_use, &used, used | (1ull << slot), __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+            return slot;
+    }
+}
+
+static void release_slot(void* value)
+{
+    u32 slot = (u32)(uptr)value - 1;
+    t_slot = slot_none;
+    __c11_atomic_fetch_and(&slots_in_use, ~(1ull << slot), __ATOMIC_RELEASE);
+}
+
+static void create_slot_key(void)
+{
+    VERIFY(pthread_key_create(&slot_key, release_slot) == 0);
+}
+
+static u32 pop_global(ObjectPool* pool)
+{
+    u64 head = pool->free_head;
+    for (;;) {
+        u32 item = (u32)head;
+        if (item == 0)
+            return 0;
+        // NOTE: The object may have been popped and reused under us, then
+        //       next is garbage, but the tag has moved and the CAS fails.
+        u32 next = *next_of(pool, item);
+        u64 new_head = ((head >> 32) + 1) << 32 | next;
+        if (__c11_atomic_compare_exchange_weak(&pool->free_head, &head, new_head, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+            return item;
+    }
+}
+
+static void push_global(ObjectPool* pool, u32 const* items, u32 count)
+{
+    if (count == 0) return;
+    for (u32 i = 0; i + 1 < count; i++)
+        *next_of(pool, items[i]) = items[i + 1];
+
+    u32 first = items[0];
+    u32 last = items[count - 1];
+    u64 head = pool->free_head;
+    for (;;) {
+        *next_of(pool, last) = (u32)head;
+        u64 new_head = ((head >> 32) + 1) << 32 | first;
+        if (__c11_atomic_compare_exchange_weak(&pool->free_head, &head, new_head, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+            return;
+    }
+}
+
+static u32* next_of(ObjectPool const* pool, u32 item)
+{
+    return (u32*)object_at(pool, item);
+}
+
+static void* object_at(ObjectPool const* pool, u32 item)
+{
+    VERIFY(item != 0 && item <= pool->capacity);
+    return pool->objects + (u64)(item - 1) * pool->stride;
+}
+
+static u32 item_of(ObjectPool const* pool, void const* ptr)
+{
+    return (u32)((u64)((u8 const*)ptr - pool->objects) / pool->stride) + 1;
+}
+
+static u64 backing_size(ObjectPool const* pool)
+{
+    return __builtin_align_up((u64)pool->capacity * pool->stride, (u64)page_size());
+}
+
+static void* dispatch(Allocator* a, AllocatorEvent event)
+{
+    ObjectPool* pool = FIELD_BASE(ObjectPool, allocator, a);
+    switch (event.tag) {
+    case AllocatorEventTag_Alloc:
+        if (event.byte_count > pool->object_size) return nullptr;
+        if (event.align > pool->object_align) return nullptr;
+        return object_pool_alloc(pool);
+    case AllocatorEventTag_Free:
+        object_pool_free(pool, event.ptr);
+        return nullptr;
+    case AllocatorEventTag_Owns:
+        return object_pool_owns(pool, event.ptr) ? (void*)1 : 0;
+    }
+    return nullptr;
+}
@@ -0,0 +1,57 @@
+#pragma once
+#include "./Base.h"
+
+#include "./Allocator.h"
+#include "./Bits.h"
+#include "./Error.h"
+
+constexpr u32 object_pool_thread_max = 64;
+constexpr u32 object_pool_cache_size = 32;
+
+// NOTE: Owned by one thread each, so no atomics. Objects are stored as
+//       index + 1, the same encoding as the global free list.
+typedef struct ObjectPoolCache {
+    alignas(cache_line_size) u32 count;
+    u32 items[object_pool_cache_size];
+} ObjectPoolCache;
+
+// NOTE: Fixed size objects out of one up front allocation. Freed objects go
+//       to a per thread cache first and spill to a lock free global list,
+//       objects never handed out before are bumped from fresh_count, so
+//       neither alloc nor free ever makes a system call. Threads past
+//       object_pool_thread_max alive at once skip the cache and use the
+//       global list, a cache slot is reused once its thread exits.
+typedef struct ObjectPool {
+    u64 version;
+    Allocator allocator;
+
+    u8* objects;
+    u64 stride;
+    u64 object_size;
+    u64 object_align;
+    u32 capacity;
+
+    alignas(cache_line_size) _Atomic u64 free_head; // Index + 1 in the low half, ABA tag in the high half.
+    _Atomic u32 fresh_count;
+
+    ObjectPoolCache caches[object_pool_thread_max];
+
+#ifdef __cplusplus
+    void* alloc();
+    void free(void*);
+    bool owns(void const*) const;
+    void flush_thread_cache();
+#endif
+} ObjectPool;
+
+C_API KError object_pool_init(ObjectPool*, u64 object_size, u64 object_align, u32 capacity);
+C_API void object_pool_deinit(ObjectPool*);
+
+C_API void* object_pool_alloc(ObjectPool*);
+C_API void object_pool_free(ObjectPool*, void*);
+C_API bool object_pool_owns(ObjectPool const*, void const*);
+
+// NOTE: Hands the calling thread's cached objects back to the global list.
+//       Without it a thread's cached objects wait for the next thread that
+//       gets its slot, call it before a thread that used the pool exits.
+C_API void object_pool_flush_thread_cache(ObjectPool*);
@@ -5,6 +5,13 @@
 
 #include <sys/mman.h>
 #include <unistd.h>
+#include <stdio.h>
+
+#ifdef __linux__
+#ifndef MADV_HUGEPAGE
+#define MADV_HUGEPAGE 14
+#endif
+#endif
 
 static void* dispatch(Allocator*, AllocatorEvent event);
 
@@ -36,6 +43,82 @@ C_API void page_free(void* ptr, u64 size)
     munmap(ptr, size);
 }
 
+C_API void* page_alloc_huge(u64 size, PageHugeMode mode)
+{
+    u64 huge_size = __builtin_align_up(size, page_huge_size);
+#ifdef __linux__
+    if (mode == PageHugeMode_Explicit) {
+        void* ptr = mmap(0, huge_size, PROT_READ|PROT_WRITE, MAP_ANON|MAP_PRIVATE|MAP_HUGETLB, -1, 0);
+        if (ptr != MAP_FAILED)
+            return ptr;
+    }
+
+    // NOTE: The kernel can only use a huge page for a 2 MiB aligned 2 MiB
+    //       range, so over reserve and trim to line the start up.
+    u8* reserved = (u8*)mmap(0, huge_size + page_huge_size, PROT_READ|PROT_WRITE, MAP_ANON|MAP_PRIVATE, -1, 0);
+    if (reserved == MAP_FAILED)
+        return 0;
+    u8* ptr = (u8*)__builtin_align_up(reserved, page_huge_size);
+    if (ptr != reserved)
+        munmap(reserved, (u64)(ptr - reserved));
+    u8* end = reserved + huge_size + page_huge_size;
+    if (end != ptr + huge_size)
+        munmap(ptr + huge_size, (u64)(end - (ptr + huge_size)));
+    madvise(ptr, huge_size, MADV_HUGEPAGE);
+    return ptr;
+#else
+    (void)mode;
+    return page_alloc(huge_size);
+#endif
+}
+
+C_API void page_free_huge(void* ptr, u64 size)
+{
+    munmap(ptr, __builtin_align_up(size, page_huge_size));
+}
+
+C_API PageHugeReport page_huge_report(void const* ptr, u64 size)
+{
+    PageHugeReport report = {
+        .size = __builtin_align_up(size, page_huge_size),
+        .huge_pages = 0,
+        .huge_page_size = page_huge_size,
+        .is_explicit = false,
+    };
+#ifdef __linux__
+    // NOTE: smaps is the only place the kernel says how a range is backed.
+    //       Adjacent mappings with the same flags get merged, so this can
+    //       over count when a neighbour is also huge page backed.
+    FILE* smaps = fopen("/proc/self/smaps", "r");
+    if (!smaps) return report;
+
+    char line[256];
+    bool in_range = false;
+    u64 huge_kib = 0;
+    while (fgets(line, sizeof(line), smaps)) {
+        unsigned long long start = 0, end = 0;
+        if (sscanf(line, "%llx-%llx ", &start, &end) == 2) {
+            in_range = start < (u64)(uptr)ptr + report.size && end > (u64)(uptr)ptr;
+            continue;
+        }
+        if (!in_range) continue;
+
+        unsigned long long kib = 0;
+        if (sscanf(line, "AnonHugePages: %llu kB", &kib) == 1) {
+            huge_kib += kib;
+        } else if (sscanf(line, "Private_Hugetlb: %llu kB", &kib) == 1 || sscanf(line, "Shared_Hugetlb: %llu kB", &kib) == 1) {
+            huge_kib += kib;
+            if (kib) report.is_explicit = true;
+        }
+    }
+    fclose(smaps);
+    report.huge_pages = huge_kib * 1024 / page_huge_size;
+#else
+    (void)ptr;
+#endif
+    return report;
+}
+
 
 static void* dispatch_alloc(u64 size, u64 align)
 {
@@ -7,3 +7,26 @@ C_API void* page_alloc(u64 size) [[clang::allocating]];
 C_API void page_free(void* ptr, u64 size);
 
 C_API [[gnu::const]] u32 page_size(void);
+
+typedef enum PageHugeMode : u32 {
+    PageHugeMode_Transparent, // 2 MiB aligned with MADV_HUGEPAGE, the kernel decides.
+    PageHugeMode_Explicit,    // MAP_HUGETLB from the reserved pool, Transparent when it is empty.
+} PageHugeMode;
+
+typedef struct PageHugeReport {
+    u64 size;           // Mapped bytes, a multiple of page_huge_size.
+    u64 huge_pages;     // Huge pages currently backing the range.
+    u64 huge_page_size;
+    bool is_explicit;   // Came from the hugetlb pool.
+} PageHugeReport;
+
+constexpr u64 page_huge_size = 2 * 1024 * 1024;
+
+// NOTE: For large, long lived state walked by the real time threads, where
+//       4 KiB pages cost TLB misses. Transparent huge pages only show up as
+//       memory is touched, so ask for the report after initializing it.
+//       Outside Linux this is page_alloc() with the size rounded up.
+C_API void* page_alloc_huge(u64 size, PageHugeMode) [[clang::allocating]];
+C_API void page_free_huge(void* ptr, u64 size);
+C_API PageHugeReport page_huge_report(void const* ptr, u64 size);
+
@@ -1,8 +1,13 @@
 #include "./Promise.h"
 
 #include "./Verify.h"
+#include "./MPSCMailbox.h"
 
 #include <string.h>
+#include <time.h>
+
+static void settle(Promise*, PromiseStatus, u16 tag, u64 data_size, u64 data_align, void const* data);
+static bool is_ready(void*);
 
 void Promise::toss() { return promise_toss(this); }
 C_API void promise_toss(Promise* promise)
@@ -22,6 +27,24 @@ C_API bool promise_is_ready(Promise const* p)
     }
 }
 
+bool Promise::wait(struct timespec const* timeout) { return promise_wait(this, timeout); }
+C_API [[nodiscard]] bool promise_wait(Promise* promise, struct timespec const* timeout)
+{
+    if (promise_is_ready(promise)) return true;
+
+    // NOTE: The waker outlives every wait on this thread, it is only given
+    //       back when the thread exits.
+    static thread_local MailboxWaker* this_thread_waker = nullptr;
+    if (!this_thread_waker)
+        this_thread_waker = mailbox_waker_for_thread(pthread_self());
+    MailboxWaker* waker = this_thread_waker;
+    if (verify(waker != nullptr).failed) return false;
+    promise->waiter = waker;
+    auto did_timeout = mailbox_waker_park_until(waker, timeout, is_ready, promise);
+    promise->waiter = nullptr;
+    return !did_timeout.did_timeout;
+}
+
 C_API PromiseSuccess promise_init(Promise* promise, u16 seq, u16 tag, u64 data_size, u64 data_align, void const* data)
 {
     if (verify(promise_is_empty(promise)).failed) return promise_fail();
@@ -35,6 +58,8 @@ C_API PromiseSuccess promise_init(Promise* promise, u16 seq, u16 tag, u64 data_s
         .status = PromiseStatus_Pending,
         .seq = seq,
         .tag = tag,
+        .waiter = nullptr,
+        .completions = nullptr,
     };
     __builtin_memcpy(promise->data, data, data_size);
 
@@ -46,14 +71,7 @@ void Promise::reject() { return reject(0, 0, 0, nullptr); }
 void Promise::reject(u16 tag, u64 data_size, u64 data_align, void const* data) { return promise_reject(this, tag, data_size, data_align, data); }
 C_API void promise_reject(Promise* promise, u16 tag, u64 data_size, u64 data_align, void const* data)
 {
-    VERIFY(data_size <= promise_payload_size_max);
-    VERIFY(data_align <= promise_payload_align_max);
-    VERIFY(promise->status == PromiseStatus_Pending);
-    promise->tag = tag;
-    promise->align = (u8)data_align;
-    promise->size = (u8)data_size;
-    memcpy(promise->data, data, data_size);
-    promise->status = PromiseStatus_Rejected;
+    settle(promise, PromiseStatus_Rejected, tag, data_size, data_align, data);
 }
 
 
@@ -61,14 +79,7 @@ void Promise::resolve() { return resolve(0, 0, 0, nullptr); }
 void Promise::resolve(u16 tag, u64 data_size, u64 data_align, void const* data) { return promise_resolve(this, tag, data_size, data_align, data); }
 C_API void promise_resolve(Promise* promise, u16 tag, u64 data_size, u64 data_align, void const* data)
 {
-    VERIFY(data_size <= promise_payload_size_max);
-    VERIFY(data_align <= promise_payload_align_max);
-    VERIFY(promise->status == PromiseStatus_Pending);
-    promise->tag = tag;
-    promise->align = (u8)data_align;
-    promise->size = (u8)data_size;
-    memcpy(promise->data, data, data_size);
-    promise->status = PromiseStatus_Resolved;
+    settle(promise, PromiseStatus_Resolved, tag, data_size, data_align, data);
 }
 
 
@@ -89,3 +100,40 @@ C_API PromiseSuccess promise_read(Promise const* promise, u16 tag, u64 size, u64
     memcpy(buf, promise->data, size);
     return promise_ok();
 }
+
+static void settle(Promise* promise, PromiseStatus status, u16 tag, u64 data_size, u64 data_align, void const* data)
+{
+    VERIFY(data_size <= promise_payload_size_max);
+    VERIFY(data_align <= promise_payload_align_max);
+    VERIFY(promise->status == PromiseStatus_Pending);
+    promise->tag = tag;
+    promise->align = (u8)data_align;
+    promise->size = (u8)data_size;
+    memcpy(promise->data, data, data_size);
+
+    // NOTE: Everything the owner may touch is read before status flips, after
+    //       that the slot can be tossed and reused at any moment.
+    MPSCMailbox* completions = promise->completions;
+    u16 seq = promise->seq;
+    promise->status = status;
+
+    // NOTE: status is stored before waiter is loaded and wait() does the
+    //       opposite, so either we see the waiter or it sees the status.
+    if (MailboxWaker* waker = promise->waiter)
+        mailbox_waker_wake(waker);
+
+    if (completions) {
+        // NOTE: Posting never waits, a full mailbox fails with EWOULDBLOCK
+        //       and only loses the event. The promise itself is still ready
+        //       for wait() or polling.
+        (void)completions->post(PromiseCompletion{
+            .promise = promise,
+            .seq = seq,
+        });
+    }
+}
+
+static bool is_ready(void* user)
+{
+    return promise_is_ready((Promise const*)user);
+}
@@ -2,10 +2,14 @@
 #include "./Base.h"
 
 #include "./Allocator.h"
+#include "./Mailbox.h"
 #ifdef __cplusplus
 #include "./TypeId.h"
 #endif
 
+typedef struct MPSCMailbox MPSCMailbox;
+typedef struct Promise Promise;
+
 enum PromiseStatus : u8 {
     PromiseStatus_Garbage = 0,
     PromiseStatus_Pending,
@@ -17,7 +21,17 @@ typedef struct [[nodiscard]] { bool ok; } PromiseSuccess;
 C_INLINE PromiseSuccess promise_ok() { return (PromiseSuccess){true}; }
 C_INLINE PromiseSuccess promise_fail() { return (PromiseSuccess){false}; }
 
-constexpr u64 promise_payload_size_max = 57;
+// NOTE: Posted to a promise's completion mailbox once it is resolved or
+//       rejected, seq tells a recycled slot apart from the original request.
+DEFINE_MESSAGE(PromiseCompletion) {
+    Promise* promise;
+    u16 seq;
+};
+
+// NOTE: What is left of a cache line after the header and the waiter and
+//       completions pointers. Typed requests and replies larger than this
+//       fail to compile, untyped ones are rejected by promise_init().
+constexpr u64 promise_payload_size_max = 40;
 constexpr u64 promise_payload_align_max = 16;
 typedef struct [[nodiscard]] Promise {
     alignas(promise_payload_align_max) u8 data[promise_payload_size_max];
@@ -27,9 +41,14 @@ typedef struct [[nodiscard]] Promise {
     u16 seq;
     u16 tag;
 
+    MailboxWaker* _Atomic waiter; // Set while a thread is parked in wait().
+    MPSCMailbox* completions;     // Optional, receives a PromiseCompletion.
+
 #ifdef __cplusplus
     void toss();
     bool is_ready() const;
+    [[nodiscard]] bool wait(struct timespec const* timeout = nullptr);
+    [[nodiscard]] bool wait(struct timespec const& timeout) { return wait(&timeout); }
     bool is_rejected() const { return status == PromiseStatus_Rejected; }
     bool is_resolved() const { return status == PromiseStatus_Resolved; }
     bool is_empty() const { return status == PromiseStatus_Garbage; }
@@ -75,6 +94,10 @@ C_INLINE bool promise_is_empty(Promise const* p) { return p->status == PromiseSt
 
 C_API void promise_toss(Promise*);
 
+// NOTE: Parks the calling thread until the promise is resolved or rejected,
+//       returns false if timeout (relative, nullptr for none) ran out first.
+C_API [[nodiscard]] bool promise_wait(Promise*, struct timespec const* timeout);
+
 C_API void promise_reject(Promise*, u16 tag, u64 data_size, u64 data_align, void const* data);
 C_API void promise_resolve(Promise*, u16 tag, u64 data_size, u64 data_align, void const* data);
 
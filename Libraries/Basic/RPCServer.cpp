@@ -5,6 +5,8 @@
 
 #include <errno.h>
 
+static Promise* claim(RPCServer*, MPSCMailbox* completions, u16 tag, u64 data_size, u64 data_align, void const* data);
+
 C_API RPCServer rpc_server_init(Mailbox* worker)
 {
     auto s = (RPCServer){
@@ -19,6 +21,52 @@ C_API RPCServer rpc_server_init(Mailbox* worker)
 
 Promise* RPCServer::request(u16 tag, u64 data_size, u64 data_align, void const* data) { return rpc_request(this, tag, data_size, data_align, data); }
 C_API Promise* rpc_request(RPCServer* s, u16 tag, u64 data_size, u64 data_align, void const* data)
+{
+    return rpc_request_into(s, nullptr, tag, data_size, data_align, data);
+}
+
+Promise* RPCServer::request(MPSCMailbox* completions, u16 tag, u64 data_size, u64 data_align, void const* data) { return rpc_request_into(this, completions, tag, data_size, data_align, data); }
+C_API Promise* rpc_request_into(RPCServer* s, MPSCMailbox* completions, u16 tag, u64 data_size, u64 data_align, void const* data)
+{
+    Promise* promise = claim(s, completions, tag, data_size, data_align, data);
+    if (!promise) return nullptr;
+    if (verify(s->worker->writer()->post(RPCRequest(promise)).ok).failed) {
+        *promise = promise_empty();
+        return nullptr;
+    }
+
+    s->seq += 1;
+    return promise;
+}
+
+u32 RPCServer::request_many(RPCBatchItem const* items, u32 count, MPSCMailbox* completions, Promise** out) { return rpc_request_many(this, items, count, completions, out); }
+C_API u32 rpc_request_many(RPCServer* s, RPCBatchItem const* items, u32 count, MPSCMailbox* completions, Promise** out)
+{
+    auto* writer = s->worker->writer();
+
+    u32 submitted = 0;
+    for (; submitted < count; submitted++) {
+        auto const& item = items[submitted];
+        Promise* promise = claim(s, completions, item.tag, item.data_size, item.data_align, item.data);
+        if (!promise) break;
+
+        RPCRequest* request = nullptr;
+        if (!writer->reserve(&request).ok) {
+            *promise = promise_empty();
+            break;
+        }
+        *request = RPCRequest(promise);
+        out[submitted] = promise;
+        s->seq += 1;
+    }
+    writer->commit();
+
+    for (u32 i = submitted; i < count; i++)
+        out[i] = nullptr;
+    return submitted;
+}
+
+static Promise* claim(RPCServer* s, MPSCMailbox* completions, u16 tag, u64 data_size, u64 data_align, void const* data)
 {
     if (verify(data_size <= promise_payload_size_max).failed) return nullptr;
     if (verify(data_align <= promise_payload_align_max).failed) return nullptr;
@@ -28,12 +76,7 @@ C_API Promise* rpc_request(RPCServer* s, u16 tag, u64 data_size, u64 data_align,
     Promise* promise = &s->items[slot];
     if (verify(promise_is_empty(promise)).failed) return nullptr;
     if (verify(promise_init(promise, seq, tag, data_size, data_align, data).ok).failed) return nullptr;
-    if (verify(s->worker->writer()->post(RPCRequest(promise)).ok).failed) {
-        *promise = promise_empty();
-        return nullptr;
-    }
-
-    s->seq += 1;
+    promise->completions = completions;
     return promise;
 }
 
@@ -3,9 +3,16 @@
 #include "./Mailbox.h"
 #include "./Promise.h"
 
-typedef struct RPCRequest {
+DEFINE_MESSAGE(RPCRequest) {
     Promise* promise;
-} RPCRequest;
+};
+
+typedef struct RPCBatchItem {
+    u16 tag;
+    u64 data_size;
+    u64 data_align;
+    void const* data;
+} RPCBatchItem;
 
 static constexpr u64 rpc_capacity = 1024;
 typedef struct RPCServer {
@@ -19,6 +26,12 @@ typedef struct RPCServer {
     Promise* request(T const& value) { return request(Ty2::type_id<T>(), sizeof(T), alignof(T), &value); }
     Promise* request(u16 tag, u64 data_size, u64 data_align, void const* data);
 
+    template <typename T>
+    Promise* request(MPSCMailbox* completions, T const& value) { return request(completions, Ty2::type_id<T>(), sizeof(T), alignof(T), &value); }
+    Promise* request(MPSCMailbox* completions, u16 tag, u64 data_size, u64 data_align, void const* data);
+
+    u32 request_many(RPCBatchItem const* items, u32 count, MPSCMailbox* completions, Promise** out);
+
     template <typename T>
     KError signal(T const& value) { return signal(Ty2::type_id<T>(), sizeof(T), alignof(T), &value); }
     KError signal(u16 tag, u64 data_size, u64 data_align, void const* data);
@@ -27,4 +40,13 @@ typedef struct RPCServer {
 
 C_API RPCServer rpc_server_init(Mailbox* worker);
 C_API Promise* rpc_request(RPCServer* s, u16 tag, u64 data_size, u64 data_align, void const* data);
+
+// NOTE: Like rpc_request, but a PromiseCompletion is posted to completions
+//       (may be nullptr) when the worker resolves or rejects the promise.
+C_API Promise* rpc_request_into(RPCServer* s, MPSCMailbox* completions, u16 tag, u64 data_size, u64 data_align, void const* data);
+
+// NOTE: Submits items in order and publishes them to the worker with a single
+//       commit, so the whole batch costs one wakeup. Returns how many were
+//       submitted, out[i] is nullptr for the ones that were not.
+C_API u32 rpc_request_many(RPCServer* s, RPCBatchItem const* items, u32 count, MPSCMailbox* completions, Promise** out);
 C_API KError rpc_signal(RPCServer* s, u16 tag, u64 data_size, u64 data_align, void const* data);
@@ -10,10 +10,20 @@
 #include <unistd.h>
 #include <sys/mman.h>
 #include <errno.h>
+#include <stdlib.h>
+#endif
+
+#ifdef __linux__
+#include <linux/memfd.h>
+#include <sys/syscall.h>
 #endif
 
 #if PLATFORM_POSIX
 
+static int open_memfd(u64 capacity, unsigned flags);
+static int open_tmpfile(u64 capacity);
+static KError map_twice(int fd, u64 offset, u64 capacity, u64 alignment, u8** out);
+
 C_API KError ring_buffer_init(RingBuffer* rb, u32 min_capacity)
 {
     TRY(ring_buffer_lazy_init(rb, min_capacity));
@@ -29,9 +39,11 @@ C_API KError ring_buffer_lazy_init(RingBuffer* rb, u32 min_capacity)
     *rb = (RingBuffer){
         .version = sizeof(RingBuffer),
         .items = nullptr,
-        .read_offset = 0u,
-        .write_offset = 0u,
         .capacity = actual_capacity,
+        .write_offset = 0u,
+        .cached_read_offset = 0u,
+        .read_offset = 0u,
+        .cached_write_offset = 0u,
     };
     return kerror_none;
 }
@@ -42,49 +54,53 @@ C_API KError ring_buffer_ensure_initialized(RingBuffer* rb)
     if (!C_ASSERT(rb->capacity > 0)) return kerror_unix(EINVAL);
     if (rb->items) return kerror_none;
 
-    char tmp_path[] = "/tmp/basic-ring-buffer-XXXXXX";
-    int fd = mkstemp(tmp_path);
-    if (fd < 0) return kerror_unix(errno);
-
-    if (unlink(tmp_path) < 0) {
-        close(fd);
-        return kerror_unix(errno);
-    }
-
-    if (ftruncate(fd, rb->capacity) < 0) {
-        close(fd);
-        return kerror_unix(errno);
-    }
-
-    u8* address = (u8*)mmap(NULL, 2 * (u64)rb->capacity, PROT_NONE, MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
-    if (address == MAP_FAILED) {
-        close(fd);
-        return kerror_unix(errno);
-    }
-
-    u8* other_address = (u8*)mmap(address, rb->capacity, PROT_READ|PROT_WRITE, MAP_FIXED|MAP_SHARED, fd, 0);
-    if (other_address != address) {
-        munmap(address, 2 * (u64)rb->capacity);
-        close(fd);
-        return kerror_unix(errno);
-    }
+    u8* address = nullptr;
+    TRY(ring_buffer_map(rb->capacity, &address));
+    rb->items = address;
+    return kerror_none;
+}
 
-    other_address = (u8*)mmap(address + rb->capacity, rb->capacity, PROT_READ|PROT_WRITE, MAP_FIXED|MAP_SHARED, fd, 0);
-    if (other_address != address + rb->capacity) {
-        munmap(address, 2 * (u64)rb->capacity);
-        close(fd);
-        return kerror_unix(errno);
+C_API KError ring_buffer_map(u64 capacity, u8** out)
+{
+    if (!C_ASSERT(capacity > 0 && capacity % page_size() == 0)) return kerror_unix(EINVAL);
+
+    int fd = -1;
+#ifdef __linux__
+    // NOTE: Huge pages have to be reserved up front (vm.nr_hugepages), so
+    //       MFD_HUGETLB is only tried for rings that are a whole number of
+    //       them and quietly falls back to normal pages when none are left.
+    if (capacity % ring_buffer_huge_page_size == 0) {
+        fd = open_memfd(capacity, MFD_HUGETLB);
+        if (fd >= 0) {
+            KError result = map_twice(fd, 0, capacity, ring_buffer_huge_page_size, out);
+            close(fd);
+            if (result.ok) return kerror_none;
+        }
     }
+#endif
+    TRY(ring_buffer_create_fd(capacity, &fd));
 
-    if (close(fd) < 0) {
-        munmap(address, 2 * (u64)rb->capacity);
-        return kerror_unix(errno);
-    }
+    KError result = ring_buffer_map_fd(fd, 0, capacity, out);
+    close(fd);
+    return result;
+}
 
-    rb->items = address;
+C_API KError ring_buffer_create_fd(u64 size, int* out)
+{
+    int fd = open_memfd(size, 0);
+    if (fd < 0) fd = open_tmpfile(size);
+    if (fd < 0) return kerror_unix(errno);
+    *out = fd;
     return kerror_none;
 }
 
+C_API KError ring_buffer_map_fd(int fd, u64 offset, u64 capacity, u8** out)
+{
+    if (!C_ASSERT(capacity > 0 && capacity % page_size() == 0)) return kerror_unix(EINVAL);
+    if (!C_ASSERT(offset % page_size() == 0)) return kerror_unix(EINVAL);
+    return map_twice(fd, offset, capacity, page_size(), out);
+}
+
 C_API void ring_buffer_deinit(RingBuffer* rb)
 {
     rb->read_offset = rb->write_offset;
@@ -111,19 +127,35 @@ C_API u8 const* ring_buffer_read_ptr(RingBuffer const* rb)
     return rb->items + (rb->read_offset % rb->capacity);
 }
 
-C_API u32 ring_buffer_size(RingBuffer const* rb)
+C_API u32 ring_buffer_size(RingBuffer* rb)
+{
+    // NOTE: Only the consumer asks this, so the cached write_offset is
+    //       refreshed only when the buffer looks empty.
+    u32 read_offset = rb->read_offset;
+    if (rb->cached_write_offset == read_offset)
+        rb->cached_write_offset = rb->write_offset;
+    u32 count = rb->cached_write_offset - read_offset;
+    if (!C_ASSERT(count <= rb->capacity)) return rb->capacity;
+    return count;
+}
+
+C_API u32 ring_buffer_size_left(RingBuffer const* rb)
 {
     i64 read_offset = rb->read_offset;
     i64 write_offset = rb->write_offset;
     i64 count = write_offset - read_offset;
-    if (!C_ASSERT(count >= 0)) return 0;
-    if (!C_ASSERT(count <= rb->capacity)) return rb->capacity;
-    return (u32)count;
+    if (!C_ASSERT(count >= 0)) return rb->capacity;
+    if (!C_ASSERT(count <= rb->capacity)) return 0;
+    return rb->capacity - (u32)count;
 }
 
-C_API u32 ring_buffer_size_left(RingBuffer const* rb)
+C_API bool ring_buffer_has_room(RingBuffer* rb, u32 bytes)
 {
-    return rb->capacity - ring_buffer_size(rb);
+    u32 write_offset = rb->write_offset;
+    if ((u64)(write_offset - rb->cached_read_offset) + bytes <= rb->capacity)
+        return true;
+    rb->cached_read_offset = rb->read_offset;
+    return (u64)(write_offset - rb->cached_read_offset) + bytes <= rb->capacity;
 }
 
 C_API void ring_buffer_produce(RingBuffer* rb, u32 bytes)
@@ -140,6 +172,79 @@ C_API void ring_buffer_consume(RingBuffer* rb, u32 bytes)
     rb->read_offset += bytes;
 }
 
+static int open_memfd(u64 capacity, unsigned flags)
+{
+#ifdef __linux__
+    int fd = (int)syscall(SYS_memfd_create, "basic-ring-buffer", MFD_CLOEXEC | flags);
+    if (fd < 0) return -1;
+    if (ftruncate(fd, (off_t)capacity) < 0) {
+        int error = errno;
+        close(fd);
+        errno = error;
+        return -1;
+    }
+    return fd;
+#else
+    (void)capacity;
+    (void)flags;
+    errno = ENOSYS;
+    return -1;
+#endif
+}
+
+static int open_tmpfile(u64 capacity)
+{
+    char shm_path[] = "/dev/shm/basic-ring-buffer-XXXXXX";
+    char tmp_path[] = "/tmp/basic-ring-buffer-XXXXXX";
+
+    char* path = shm_path;
+    int fd = mkstemp(shm_path);
+    if (fd < 0) {
+        path = tmp_path;
+        fd = mkstemp(tmp_path);
+        if (fd < 0) return -1;
+    }
+
+    if (unlink(path) < 0 || ftruncate(fd, (off_t)capacity) < 0) {
+        int error = errno;
+        close(fd);
+        errno = error;
+        return -1;
+    }
+    return fd;
+}
+
+static KError map_twice(int fd, u64 offset, u64 capacity, u64 alignment, u8** out)
+{
+    // NOTE: Reserve enough to line the start up on alignment, then hand the
+    //       slack on either side back before mapping the file over it twice.
+    u64 slack = alignment > page_size() ? alignment : 0;
+    u8* reserved = (u8*)mmap(NULL, 2 * capacity + slack, PROT_NONE, MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
+    if (reserved == MAP_FAILED) return kerror_unix(errno);
+
+    u8* address = (u8*)__builtin_align_up(reserved, alignment);
+    u8* end = address + 2 * capacity;
+    if (address != reserved) munmap(reserved, (u64)(address - reserved));
+    if (end != reserved + 2 * capacity + slack) munmap(end, (u64)(reserved + 2 * capacity + slack - end));
+
+    u8* other_address = (u8*)mmap(address, capacity, PROT_READ|PROT_WRITE, MAP_FIXED|MAP_SHARED, fd, (off_t)offset);
+    if (other_address != address) {
+        int error = errno;
+        munmap(address, 2 * capacity);
+        return kerror_unix(error);
+    }
+
+    other_address = (u8*)mmap(address + capacity, capacity, PROT_READ|PROT_WRITE, MAP_FIXED|MAP_SHARED, fd, (off_t)offset);
+    if (other_address != address + capacity) {
+        int error = errno;
+        munmap(address, 2 * capacity);
+        return kerror_unix(error);
+    }
+
+    *out = address;
+    return kerror_none;
+}
+
 #else
 #error "unsupported OS"
 #endif
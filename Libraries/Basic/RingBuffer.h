@@ -1,5 +1,6 @@
 #pragma once
 #include "./Types.h"
+#include "./Bits.h"
 
 #include "./Error.h"
 
@@ -7,9 +8,15 @@ typedef struct RingBuffer {
     u64 version;
 
     u8* items;
-    _Atomic u32 read_offset;
-    _Atomic u32 write_offset;
     u32 capacity;
+
+    // NOTE: Producer and consumer each own a cache line and keep a copy of
+    //       the other side's offset, reloaded only when full or empty.
+    alignas(cache_line_size) _Atomic u32 write_offset;
+    u32 cached_read_offset; // Producer only.
+
+    alignas(cache_line_size) _Atomic u32 read_offset;
+    u32 cached_write_offset; // Consumer only.
 } RingBuffer;
 
 C_API KError ring_buffer_init(RingBuffer*, u32 min_capacity);
@@ -17,10 +24,22 @@ C_API KError ring_buffer_lazy_init(RingBuffer*, u32 min_capacity);
 C_API KError ring_buffer_ensure_initialized(RingBuffer*);
 C_API void ring_buffer_deinit(RingBuffer*);
 
+// NOTE: Maps capacity bytes twice back to back, memfd backed on Linux with
+//       a /dev/shm or /tmp file as fallback. Capacities that are a multiple
+//       of ring_buffer_huge_page_size try huge pages first.
+static constexpr u64 ring_buffer_huge_page_size = 2 * 1024 * 1024;
+C_API KError ring_buffer_map(u64 capacity, u8** out);
+
+// NOTE: The same as two steps, for rings that live in a file shared with
+//       another process. offset and capacity must be page aligned.
+C_API KError ring_buffer_create_fd(u64 size, int* out);
+C_API KError ring_buffer_map_fd(int fd, u64 offset, u64 capacity, u8** out);
+
 C_API u8* ring_buffer_write_ptr(RingBuffer const*);
 C_API u8 const* ring_buffer_read_ptr(RingBuffer const*);
 
-C_API u32 ring_buffer_size(RingBuffer const*);
-C_API u32 ring_buffer_size_left(RingBuffer const*);
+C_API u32 ring_buffer_size(RingBuffer*);            // Consumer side, may lag behind the producer.
+C_API u32 ring_buffer_size_left(RingBuffer const*); // Exact, always reloads read_offset.
+C_API bool ring_buffer_has_room(RingBuffer*, u32 bytes); // Producer side, reloads only when short.
 C_API void ring_buffer_produce(RingBuffer*, u32 bytes);
 C_API void ring_buffer_consume(RingBuffer*, u32 bytes);
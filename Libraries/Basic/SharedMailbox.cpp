@@ -0,0 +1,275 @@
+#include "./SharedMailbox.h"
+#include "./MailboxMessage.h"
+
+#include "./Allocator.h"
+#include "./Verify.h"
+#include "./PageAllocator.h"
+#include "./RingBuffer.h"
+#include "./TypeId.h"
+#include "./Bits.h"
+#include "./Error.h"
+
+#include <errno.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <time.h>
+
+#ifdef __linux__
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#endif
+
+static u64 unread_count(SharedMailbox*);
+static bool has_room(SharedMailbox*, u64 bytes);
+
+static KError map(int fd, u64 capacity, SharedMailbox*);
+static u64 control_size(void);
+
+static void futex_wake(_Atomic u32*);
+static void futex_wait(_Atomic u32*, u32 value, struct timespec const* deadline);
+
+C_API KError shared_mailbox_create(u32 min_capacity, SharedMailbox* mb)
+{
+    if (verify(min_capacity != 0).failed) return kerror_unix(EINVAL);
+    VERIFY(!ty_is_initialized(mb));
+
+    u64 capacity = __builtin_align_up((u64)min_capacity, (u64)page_size());
+    int fd = -1;
+    if (auto result = ring_buffer_create_fd(control_size() + capacity, &fd); !result.ok)
+        return result;
+
+    auto* control = (SharedMailboxControl*)mmap(nullptr, control_size(), PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+    if (control == MAP_FAILED) {
+        int error = errno;
+        close(fd);
+        return kerror_unix(error);
+    }
+    memzero(control);
+    control->capacity = capacity;
+    ty_set_initialized(control);
+    munmap(control, control_size());
+
+    if (auto result = map(fd, capacity, mb); !result.ok) {
+        close(fd);
+        return result;
+    }
+    return kerror_none;
+}
+
+C_API KError shared_mailbox_open(int fd, SharedMailbox* mb)
+{
+    VERIFY(!ty_is_initialized(mb));
+
+    struct stat st;
+    if (fstat(fd, &st) < 0) {
+        int error = errno;
+        close(fd);
+        return kerror_unix(error);
+    }
+    guard ((u64)st.st_size > control_size()) else {
+        close(fd);
+        return kerror_unix(EINVAL);
+    }
+
+    u64 capacity = (u64)st.st_size - control_size();
+    guard (capacity % page_size() == 0) else {
+        close(fd);
+        return kerror_unix(EINVAL);
+    }
+    if (auto result = map(fd, capacity, mb); !result.ok) {
+        close(fd);
+        return result;
+    }
+    return kerror_none;
+}
+
+C_API void shared_mailbox_close(SharedMailbox* mb)
+{
+    if (!ty_is_initialized(mb)) return;
+    if (mb->items) munmap(mb->items, 2 * mb->capacity);
+    if (mb->control) munmap(mb->control, control_size());
+    if (mb->fd >= 0) close(mb->fd);
+    memzero(mb);
+}
+
+KError SharedMailbox::post(u16 tag, u64 size, u64 align, void const* data) { return shared_mailbox_post(this, tag, size, align, data); }
+C_API KError shared_mailbox_post(SharedMailbox* mb, u16 tag, u64 size, u64 align, void const* data)
+{
+    void* payload = nullptr;
+    if (auto result = shared_mailbox_reserve(mb, tag, size, align, &payload); !result.ok)
+        return result;
+    memcpy(payload, data, size);
+    shared_mailbox_commit(mb);
+    return kerror_none;
+}
+
+KError SharedMailbox::reserve(u16 tag, u64 size, u64 align, void** out) { return shared_mailbox_reserve(this, tag, size, align, out); }
+C_API KError shared_mailbox_reserve(SharedMailbox* mb, u16 tag, u64 size, u64 align, void** out)
+{
+    guard (ty_is_initialized(mb)) else return kerror_unix(EINVAL);
+    guard (size <= message_size_max) else return kerror_unix(EINVAL);
+    guard (align <= message_align_max) else return kerror_unix(EINVAL);
+    guard ((align & (align - 1)) == 0) else return kerror_unix(EINVAL);
+    guard (ty_type_name(tag) && "type has not been ty_type_register()'ed") else return kerror_unix(EINVAL);
+
+    u64 worst_case = sizeof(Message) + (align ? align - 1 : 0) + size + message_stride_align;
+    guard (worst_case < mb->capacity) else return kerror_unix(EMSGSIZE);
+    if (!has_room(mb, worst_case))
+        return kerror_unix(EWOULDBLOCK);
+
+    u64 write_offset = mb->control->write_offset + mb->write_pending;
+    auto* m = (Message*)(mb->items + (write_offset % mb->capacity));
+    *m = (Message){
+        .tag = tag,
+        .align = (u16)align,
+        .size = (u32)size,
+    };
+    *out = message_data(m);
+    mb->write_pending += message_stride(m);
+    return kerror_none;
+}
+
+void SharedMailbox::commit() { return shared_mailbox_commit(this); }
+C_API void shared_mailbox_commit(SharedMailbox* mb)
+{
+    u64 pending = mb->write_pending;
+    if (pending == 0)
+        return;
+    mb->write_pending = 0;
+
+    auto* control = mb->control;
+    control->write_offset += pending;
+    control->wakeup += 1;
+    if (control->reader_parked)
+        futex_wake(&control->wakeup);
+}
+
+MailboxStatus SharedMailbox::peek_span(u16* tag, void const** data, u64* size) { return shared_mailbox_peek_span(this, tag, data, size); }
+C_API MailboxStatus shared_mailbox_peek_span(SharedMailbox* mb, u16* tag, void const** data, u64* size)
+{
+    VERIFY(tag != nullptr);
+    VERIFY(data != nullptr);
+    VERIFY(size != nullptr);
+    if (unread_count(mb) == 0) return mailbox_empty();
+
+    u64 read_offset = mb->control->read_offset + mb->read_pending;
+    auto const* message = (Message const*)(mb->items + (read_offset % mb->capacity));
+    *tag = message->tag;
+    *data = message_data(message);
+    *size = message->size;
+    mb->read_pending += message_stride(message);
+    return mailbox_found();
+}
+
+void SharedMailbox::release() { return shared_mailbox_release(this); }
+C_API void shared_mailbox_release(SharedMailbox* mb)
+{
+    u64 pending = mb->read_pending;
+    if (pending == 0)
+        return;
+    mb->read_pending = 0;
+    mb->control->read_offset += pending;
+}
+
+MailboxDidTimeout SharedMailbox::wait(struct timespec const* timeout) { return shared_mailbox_wait(this, timeout); }
+C_API MailboxDidTimeout shared_mailbox_wait(SharedMailbox* mb, struct timespec const* timeout)
+{
+    struct timespec deadline = {};
+    if (timeout)
+        deadline = deadline_after(timeout);
+
+    // NOTE: Same protocol as the in process waker: sample wakeup, check,
+    //       then park only if wakeup has not moved since the sample.
+    auto* control = mb->control;
+    for (;;) {
+        u32 wakeup = control->wakeup;
+        if (unread_count(mb) != 0)
+            break;
+        if (timeout && deadline_has_passed(&deadline))
+            return (MailboxDidTimeout){true};
+        control->reader_parked = 1;
+        if (unread_count(mb) == 0)
+            futex_wait(&control->wakeup, wakeup, timeout ? &deadline : nullptr);
+        control->reader_parked = 0;
+    }
+    return (MailboxDidTimeout){false};
+}
+
+static u64 unread_count(SharedMailbox* mb)
+{
+    u64 read_end = mb->control->read_offset + mb->read_pending;
+    if (mb->cached_write_offset == read_end)
+        mb->cached_write_offset = mb->control->write_offset;
+    VERIFY(mb->cached_write_offset >= read_end);
+    return mb->cached_write_offset - read_end;
+}
+
+static bool has_room(SharedMailbox* mb, u64 bytes)
+{
+    u64 write_end = mb->control->write_offset + mb->write_pending;
+    if (write_end - mb->cached_read_offset + bytes < mb->capacity)
+        return true;
+    mb->cached_read_offset = mb->control->read_offset;
+    VERIFY(write_end - mb->cached_read_offset <= mb->capacity);
+    return write_end - mb->cached_read_offset + bytes < mb->capacity;
+}
+
+static KError map(int fd, u64 capacity, SharedMailbox* mb)
+{
+    auto* control = (SharedMailboxControl*)mmap(nullptr, control_size(), PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+    if (control == MAP_FAILED) return kerror_unix(errno);
+    if (!ty_is_initialized(control) || control->capacity != capacity) {
+        munmap(control, control_size());
+        return kerror_unix(EINVAL);
+    }
+
+    u8* items = nullptr;
+    if (auto result = ring_buffer_map_fd(fd, control_size(), capacity, &items); !result.ok) {
+        munmap(control, control_size());
+        return result;
+    }
+
+    memzero(mb);
+    mb->fd = fd;
+    mb->control = control;
+    mb->items = items;
+    mb->capacity = capacity;
+    mb->cached_read_offset = control->read_offset;
+    mb->cached_write_offset = control->write_offset;
+    ty_set_initialized(mb);
+    return kerror_none;
+}
+
+static u64 control_size(void)
+{
+    static_assert(sizeof(SharedMailboxControl) <= 4096);
+    return page_size();
+}
+
+static void futex_wake(_Atomic u32* word)
+{
+#ifdef __linux__
+    // NOTE: Not FUTEX_PRIVATE_FLAG, the reader is in another process.
+    syscall(SYS_futex, word, FUTEX_WAKE, 1, nullptr, nullptr, 0);
+#else
+    (void)word;
+#endif
+}
+
+static void futex_wait(_Atomic u32* word, u32 value, struct timespec const* deadline)
+{
+    // NOTE: Spurious returns and EINTR are fine, the caller rechecks.
+#ifdef __linux__
+    syscall(SYS_futex, word, FUTEX_WAIT_BITSET, value, deadline, nullptr, FUTEX_BITSET_MATCH_ANY);
+#else
+    // NOTE: No process shared wait outside Linux, poll at a rate that is
+    //       still well below one audio block.
+    (void)word;
+    (void)value;
+    (void)deadline;
+    struct timespec interval = { .tv_sec = 0, .tv_nsec = 100000 };
+    nanosleep(&interval, nullptr);
+#endif
+}
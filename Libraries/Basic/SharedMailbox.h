@@ -0,0 +1,71 @@
+#pragma once
+#include "./Base.h"
+
+#include "./Mailbox.h"
+
+typedef struct SharedMailbox SharedMailbox;
+typedef struct SharedMailboxControl SharedMailboxControl;
+
+// NOTE: Lives in the first page of the shared file, the ring follows it.
+//       Only offsets are shared, every process maps the ring wherever it
+//       likes. wakeup is a process shared futex word on Linux.
+typedef struct SharedMailboxControl {
+    u64 version;
+    u64 capacity;
+
+    alignas(cache_line_size) _Atomic u64 write_offset;
+    _Atomic u32 wakeup;
+
+    alignas(cache_line_size) _Atomic u64 read_offset;
+    _Atomic u32 reader_parked;
+} SharedMailboxControl;
+
+// NOTE: One writer and one reader, each normally in its own process with
+//       its own SharedMailbox over the same fd. Messages are tagged like
+//       Mailbox messages, so both sides must agree on type ids (built from
+//       the same sources). The fd is created close-on-exec, pass it to a
+//       helper by fork(), SCM_RIGHTS or by clearing FD_CLOEXEC.
+typedef struct SharedMailbox {
+    u64 version;
+
+    int fd;
+    SharedMailboxControl* control;
+    u8* items;
+    u64 capacity;
+
+    u64 write_pending;       // Writer only.
+    u64 cached_read_offset;  // Writer only.
+    u64 read_pending;        // Reader only.
+    u64 cached_write_offset; // Reader only.
+
+#ifdef __cplusplus
+    template <typename T>
+        requires (sizeof(T) <= message_size_max) && (alignof(T) <= message_align_max)
+    KError post(T const& value) { return post(Ty2::type_id<T>(), sizeof(T), alignof(T), &value); }
+    KError post(u16 tag, u64 size, u64 align, void const* data);
+
+    template <typename T>
+        requires (sizeof(T) <= message_size_max) && (alignof(T) <= message_align_max)
+    KError reserve(T** out) { return reserve(Ty2::type_id<T>(), sizeof(T), alignof(T), (void**)out); }
+    KError reserve(u16 tag, u64 size, u64 align, void** out);
+    void commit();
+
+    MailboxStatus peek_span(u16* tag, void const** data, u64* size);
+    void release();
+
+    MailboxDidTimeout wait(struct timespec const* timeout = nullptr);
+    MailboxDidTimeout wait(struct timespec const& timeout) { return wait(&timeout); }
+#endif
+} SharedMailbox;
+
+C_API KError shared_mailbox_create(u32 min_capacity, SharedMailbox*);
+C_API KError shared_mailbox_open(int fd, SharedMailbox*); // Takes ownership of fd, it is closed on failure.
+C_API void shared_mailbox_close(SharedMailbox*);
+
+C_API KError shared_mailbox_post(SharedMailbox*, u16 tag, u64 size, u64 align, void const* data);
+C_API KError shared_mailbox_reserve(SharedMailbox*, u16 tag, u64 size, u64 align, void** out);
+C_API void shared_mailbox_commit(SharedMailbox*);
+
+C_API MailboxStatus shared_mailbox_peek_span(SharedMailbox*, u16* tag, void const** data, u64* size);
+C_API void shared_mailbox_release(SharedMailbox*);
+C_API MailboxDidTimeout shared_mailbox_wait(SharedMailbox*, struct timespec const* timeout);
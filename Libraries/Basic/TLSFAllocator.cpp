@@ -0,0 +1,328 @@
+#include "./TLSFAllocator.h"
+
+#include "./Verify.h"
+#include "./PageAllocator.h"
+
+#include <errno.h>
+#include <sys/mman.h>
+
+// NOTE: prev_phys and size are the header, the free list links live in the
+//       payload and are only meaningful while the block is free.
+typedef struct TLSFBlock {
+    TLSFBlock* prev_phys;
+    u64 size; // Payload bytes, bit 0 set while free.
+    TLSFBlock* next_free;
+    TLSFBlock* prev_free;
+} TLSFBlock;
+
+constexpr u64 block_align = 1LLU << tlsf_align_log2;
+constexpr u64 block_header_size = 2 * sizeof(u64);
+constexpr u64 block_payload_min = 2 * sizeof(void*);
+constexpr u64 block_size_min = block_header_size + block_payload_min;
+constexpr u64 block_size_max = 1LLU << tlsf_fl_max;
+constexpr u64 small_block_size = 1LLU << tlsf_fl_shift;
+constexpr u64 block_free_bit = 1;
+static_assert(block_header_size % block_align == 0);
+static_assert(block_payload_min % block_align == 0);
+
+static void* dispatch(Allocator*, AllocatorEvent);
+
+static u64 block_size(TLSFBlock const*);
+static bool block_is_free(TLSFBlock const*);
+static u8* block_payload(TLSFBlock const*);
+static TLSFBlock* block_from_payload(void const*);
+static TLSFBlock* block_next(TLSFBlock const*);
+
+static void mapping_insert(u64 size, u32* fl, u32* sl);
+static void mapping_search(u64 size, u32* fl, u32* sl);
+static TLSFBlock* find_suitable(TLSFAllocator*, u32* fl, u32* sl);
+static void insert_free(TLSFAllocator*, TLSFBlock*);
+static void remove_free(TLSFAllocator*, TLSFBlock*);
+static void split(TLSFAllocator*, TLSFBlock*, u64 size);
+static TLSFBlock* split_front(TLSFAllocator*, TLSFBlock*, u64 gap);
+
+C_API KError tlsf_allocator_init(TLSFAllocator* tlsf, u64 region_size)
+{
+    if (!C_ASSERT(!ty_is_initialized(tlsf))) return kerror_unix(EINVAL);
+    u64 size = __builtin_align_up(region_size, (u64)page_size());
+    if (!C_ASSERT(size >= 2 * block_size_min)) return kerror_unix(EINVAL);
+    if (!C_ASSERT(size - 2 * block_header_size < block_size_max)) return kerror_unix(EINVAL);
+
+    int flags = MAP_ANON|MAP_PRIVATE;
+#ifdef __linux__
+    flags |= MAP_POPULATE;
+#endif
+    u8* region = (u8*)mmap(nullptr, size, PROT_READ|PROT_WRITE, flags, -1, 0);
+    if (region == MAP_FAILED) return kerror_unix(errno);
+
+    // NOTE: Write every page so it is backed by its own frame, not the
+    //       shared zero page, before it gets locked.
+    for (u64 offset = 0; offset < size; offset += page_size())
+        ((u8 volatile*)region)[offset] = 0;
+    bool is_locked = mlock(region, size) == 0;
+
+    memzero(tlsf);
+    tlsf->allocator = allocator_init(dispatch);
+    tlsf->region = region;
+    tlsf->region_size = size;
+    tlsf->is_locked = is_locked;
+
+    // NOTE: One free block spanning the region, then a zero sized used
+    //       sentinel so block_next never runs off the end when merging.
+    auto* block = (TLSFBlock*)region;
+    block->prev_phys = nullptr;
+    block->size = size - 2 * block_header_size;
+    auto* sentinel = block_next(block);
+    sentinel->prev_phys = block;
+    sentinel->size = 0;
+    insert_free(tlsf, block);
+
+    ty_set_initialized(tlsf);
+    return kerror_none;
+}
+
+C_API void tlsf_allocator_deinit(TLSFAllocator* tlsf)
+{
+    if (!ty_is_initialized(tlsf)) return;
+    if (tlsf->is_locked) munlock(tlsf->region, tlsf->region_size);
+    munmap(tlsf->region, tlsf->region_size);
+    memzero(tlsf);
+}
+
+void* TLSFAllocator::alloc(u64 size, u64 align) { return tlsf_allocator_alloc(this, size, align); }
+C_API void* tlsf_allocator_alloc(TLSFAllocator* tlsf, u64 size, u64 align)
+{
+    if (!C_ASSERT(ty_is_initialized(tlsf))) return nullptr;
+    if (size == 0) return nullptr;
+    if (align == 0) align = 1;
+    if (!C_ASSERT((align & (align - 1)) == 0)) return nullptr;
+
+    u64 payload = __builtin_align_up(size < block_payload_min ? block_payload_min : size, block_align);
+    if (payload >= block_size_max) return nullptr;
+
+    // NOTE: Over aligned requests search for enough room to cut a free block
+    //       off the front, so the aligned payload still fits behind it.
+    u64 search = payload;
+    if (align > block_align)
+        search = payload + align + block_size_min;
+
+    u32 fl = 0, sl = 0;
+    mapping_search(search, &fl, &sl);
+    TLSFBlock* block = find_suitable(tlsf, &fl, &sl);
+    if (!block) return nullptr;
+    remove_free(tlsf, block);
+
+    if (align > block_align) {
+        u8* start = block_payload(block);
+        u8* aligned = (u8*)__builtin_align_up(start, align);
+        u64 gap = (u64)(aligned - start);
+        if (gap != 0 && gap < block_size_min) {
+            aligned = (u8*)__builtin_align_up(start + block_size_min, align);
+            gap = (u64)(aligned - start);
+        }
+        if (gap != 0)
+            block = split_front(tlsf, block, gap);
+    }
+    split(tlsf, block, payload);
+
+    block->size &= ~block_free_bit;
+    tlsf->used_bytes += block_size(block);
+    tlsf->allocation_count += 1;
+    if (tlsf->used_bytes > tlsf->peak_used_bytes)
+        tlsf->peak_used_bytes = tlsf->used_bytes;
+    return block_payload(block);
+}
+
+void TLSFAllocator::free(void* ptr) { return tlsf_allocator_free(this, ptr); }
+C_API void tlsf_allocator_free(TLSFAllocator* tlsf, void* ptr)
+{
+    if (!ptr) return;
+    VERIFY((u8*)ptr > tlsf->region && (u8*)ptr < tlsf->region + tlsf->region_size);
+
+    TLSFBlock* block = block_from_payload(ptr);
+    VERIFY(!block_is_free(block));
+    tlsf->used_bytes -= block_size(block);
+    tlsf->allocation_count -= 1;
+
+    TLSFBlock* prev = block->prev_phys;
+    if (prev && block_is_free(prev)) {
+        remove_free(tlsf, prev);
+        prev->size = block_size(prev) + block_header_size + block_size(block);
+        block = prev;
+    }
+    TLSFBlock* next = block_next(block);
+    if (block_is_free(next)) {
+        remove_free(tlsf, next);
+        block->size = block_size(block) + block_header_size + block_size(next);
+    }
+    block_next(block)->prev_phys = block;
+    insert_free(tlsf, block);
+}
+
+TLSFStats TLSFAllocator::stats() const { return tlsf_allocator_stats(this); }
+C_API TLSFStats tlsf_allocator_stats(TLSFAllocator const* tlsf)
+{
+    // NOTE: Only the highest non-empty class can hold the largest block,
+    //       so this walks one list, not the whole heap.
+    u64 largest = 0;
+    if (tlsf->fl_bitmap) {
+        u32 fl = 31 - __builtin_clz(tlsf->fl_bitmap);
+        u32 sl = 31 - __builtin_clz(tlsf->sl_bitmap[fl]);
+        for (TLSFBlock const* block = tlsf->free_lists[fl][sl]; block; block = block->next_free) {
+            if (block_size(block) > largest)
+                largest = block_size(block);
+        }
+    }
+
+    return (TLSFStats){
+        .region_size = tlsf->region_size,
+        .used_bytes = tlsf->used_bytes,
+        .peak_used_bytes = tlsf->peak_used_bytes,
+        .free_bytes = tlsf->free_bytes,
+        .largest_free_block = largest,
+        .free_block_count = tlsf->free_block_count,
+        .allocation_count = tlsf->allocation_count,
+        .fragmentation = tlsf->free_bytes ? 1.0 - (f64)largest / (f64)tlsf->free_bytes : 0.0,
+        .is_locked = tlsf->is_locked,
+    };
+}
+
+static u64 block_size(TLSFBlock const* block)
+{
+    return block->size & ~block_free_bit;
+}
+
+static bool block_is_free(TLSFBlock const* block)
+{
+    return (block->size & block_free_bit) != 0;
+}
+
+static u8* block_payload(TLSFBlock const* block)
+{
+    return (u8*)block + block_header_size;
+}
+
+static TLSFBlock* block_from_payload(void const* ptr)
+{
+    return (TLSFBlock*)((u8 const*)ptr - block_header_size);
+}
+
+static TLSFBlock* block_next(TLSFBlock const* block)
+{
+    return (TLSFBlock*)(block_payload(block) + block_size(block));
+}
+
+static void mapping_insert(u64 size, u32* fl, u32* sl)
+{
+    if (size < small_block_size) {
+        *fl = 0;
+        *sl = (u32)(size / (small_block_size / tlsf_sl_count));
+        return;
+    }
+    u32 bit = 63 - __builtin_clzll(size);
+    *sl = (u32)(size >> (bit - tlsf_sl_log2)) ^ tlsf_sl_count;
+    *fl = bit - (tlsf_fl_shift - 1);
+}
+
+static void mapping_search(u64 size, u32* fl, u32* sl)
+{
+    // NOTE: Round up to the next class boundary, so any block found in the
+    //       resulting class is large enough without walking its list.
+    if (size >= small_block_size) {
+        u64 round = (1LLU << (63 - __builtin_clzll(size) - tlsf_sl_log2)) - 1;
+        size += round;
+    }
+    mapping_insert(size, fl, sl);
+}
+
+static TLSFBlock* find_suitable(TLSFAllocator* tlsf, u32* fl, u32* sl)
+{
+    if (*fl >= tlsf_fl_count) return nullptr;
+    u32 sl_map = tlsf->sl_bitmap[*fl] & (~0U << *sl);
+    if (!sl_map) {
+        u32 fl_map = *fl + 1 < 32 ? tlsf->fl_bitmap & (~0U << (*fl + 1)) : 0;
+        if (!fl_map) return nullptr;
+        *fl = __builtin_ctz(fl_map);
+        sl_map = tlsf->sl_bitmap[*fl];
+    }
+    *sl = __builtin_ctz(sl_map);
+    return tlsf->free_lists[*fl][*sl];
+}
+
+static void insert_free(TLSFAllocator* tlsf, TLSFBlock* block)
+{
+    u32 fl = 0, sl = 0;
+    mapping_insert(block_size(block), &fl, &sl);
+    block->size |= block_free_bit;
+    block->prev_free = nullptr;
+    block->next_free = tlsf->free_lists[fl][sl];
+    if (block->next_free)
+        block->next_free->prev_free = block;
+    tlsf->free_lists[fl][sl] = block;
+    tlsf->fl_bitmap |= 1U << fl;
+    tlsf->sl_bitmap[fl] |= 1U << sl;
+    tlsf->free_bytes += block_size(block);
+    tlsf->free_block_count += 1;
+}
+
+static void remove_free(TLSFAllocator* tlsf, TLSFBlock* block)
+{
+    u32 fl = 0, sl = 0;
+    mapping_insert(block_size(block), &fl, &sl);
+    if (block->prev_free) block->prev_free->next_free = block->next_free;
+    if (block->next_free) block->next_free->prev_free = block->prev_free;
+    if (tlsf->free_lists[fl][sl] == block) {
+        tlsf->free_lists[fl][sl] = block->next_free;
+        if (!block->next_free) {
+            tlsf->sl_bitmap[fl] &= ~(1U << sl);
+            if (!tlsf->sl_bitmap[fl])
+                tlsf->fl_bitmap &= ~(1U << fl);
+        }
+    }
+    block->size &= ~block_free_bit;
+    tlsf->free_bytes -= block_size(block);
+    tlsf->free_block_count -= 1;
+}
+
+static void split(TLSFAllocator* tlsf, TLSFBlock* block, u64 size)
+{
+    u64 total = block_size(block);
+    if (total < size + block_size_min)
+        return;
+
+    auto* rest = (TLSFBlock*)(block_payload(block) + size);
+    rest->prev_phys = block;
+    rest->size = total - size - block_header_size;
+    block->size = size;
+    block_next(rest)->prev_phys = rest;
+    insert_free(tlsf, rest);
+}
+
+static TLSFBlock* split_front(TLSFAllocator* tlsf, TLSFBlock* block, u64 gap)
+{
+    VERIFY(gap >= block_size_min);
+    u64 total = block_size(block);
+
+    auto* rest = (TLSFBlock*)((u8*)block + gap);
+    rest->prev_phys = block;
+    rest->size = total - gap;
+    block->size = gap - block_header_size;
+    block_next(rest)->prev_phys = rest;
+    insert_free(tlsf, block);
+    return rest;
+}
+
+static void* dispatch(Allocator* a, AllocatorEvent event)
+{
+    TLSFAllocator* tlsf = FIELD_BASE(TLSFAllocator, allocator, a);
+    switch (event.tag) {
+    case AllocatorEventTag_Alloc:
+        return tlsf_allocator_alloc(tlsf, event.byte_count, event.align);
+    case AllocatorEventTag_Free:
+        tlsf_allocator_free(tlsf, event.ptr);
+        return nullptr;
+    case AllocatorEventTag_Owns:
+        return ((u8*)event.ptr >= tlsf->region && (u8*)event.ptr < tlsf->region + tlsf->region_size) ? (void*)1 : 0;
+    }
+    return nullptr;
+}
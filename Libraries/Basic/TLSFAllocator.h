@@ -0,0 +1,66 @@
+#pragma once
+#include "./Base.h"
+
+#include "./Allocator.h"
+#include "./Error.h"
+
+// NOTE: Two level segregated fit. The first level splits sizes by power of
+//       two, the second splits each of those into tlsf_sl_count linear
+//       classes. Both levels have a bitmap, so finding a fitting free block
+//       is a couple of bit scans and alloc/free are O(1) in the worst case.
+constexpr u32 tlsf_align_log2 = 4;
+constexpr u32 tlsf_sl_log2 = 4;
+constexpr u32 tlsf_sl_count = 1 << tlsf_sl_log2;
+constexpr u32 tlsf_fl_shift = tlsf_sl_log2 + tlsf_align_log2;
+constexpr u32 tlsf_fl_max = 32; // Largest block is 4 GiB.
+constexpr u32 tlsf_fl_count = tlsf_fl_max - tlsf_fl_shift + 1;
+
+typedef struct TLSFBlock TLSFBlock;
+
+typedef struct TLSFStats {
+    u64 region_size;
+    u64 used_bytes;
+    u64 peak_used_bytes;
+    u64 free_bytes;
+    u64 largest_free_block;
+    u64 free_block_count;
+    u64 allocation_count;
+    f64 fragmentation; // 1 - largest_free_block / free_bytes.
+    bool is_locked;
+} TLSFStats;
+
+// NOTE: Not thread safe, meant to be owned by one real time thread. The
+//       region is pre-faulted and mlock()'ed on init, so no allocation can
+//       page fault. Locking failing (RLIMIT_MEMLOCK) is not an error, it
+//       shows up in stats as is_locked = false.
+typedef struct TLSFAllocator {
+    u64 version;
+    Allocator allocator;
+
+    u8* region;
+    u64 region_size;
+    bool is_locked;
+
+    u32 fl_bitmap;
+    u32 sl_bitmap[tlsf_fl_count];
+    TLSFBlock* free_lists[tlsf_fl_count][tlsf_sl_count];
+
+    u64 used_bytes;
+    u64 peak_used_bytes;
+    u64 free_bytes;
+    u64 free_block_count;
+    u64 allocation_count;
+
+#ifdef __cplusplus
+    void* alloc(u64 size, u64 align);
+    void free(void*);
+    TLSFStats stats() const;
+#endif
+} TLSFAllocator;
+
+C_API KError tlsf_allocator_init(TLSFAllocator*, u64 region_size);
+C_API void tlsf_allocator_deinit(TLSFAllocator*);
+
+C_API void* tlsf_allocator_alloc(TLSFAllocator*, u64 size, u64 align);
+C_API void tlsf_allocator_free(TLSFAllocator*, void*);
+C_API TLSFStats tlsf_allocator_stats(TLSFAllocator const*);
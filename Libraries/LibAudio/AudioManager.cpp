@@ -138,25 +138,43 @@ C_API void au_audio_prefetch(AUAudioManager* audio, AUAudioID id, i64 frame, u16
     prefetch_history_push(audio, block_id);
 }
 
-f64 AUAudioManager::sample(AUAudioID id, i64 frame, u16 channel) { return au_audio_sample(this, id, frame, channel); }
-C_API f64 au_audio_sample(AUAudioManager* audio, AUAudioID id, i64 frame, u16 channel)
+AUSample AUAudioManager::sample(AUAudioID id, i64 frame, u16 channel) { return au_audio_sample(this, id, frame, channel); }
+C_API AUSample au_audio_sample(AUAudioManager* audio, AUAudioID id, i64 frame, u16 channel)
+{
+    auto const* samples = au_audio_block_samples(audio, id, frame, channel);
+    if (!samples)
+        return 0; // Not ready.
+    return samples[((u64)frame) % au_audio_frames_per_block];
+}
+
+AUSample const* AUAudioManager::block_samples(AUAudioID id, i64 frame, u16 channel) { return au_audio_block_samples(this, id, frame, channel); }
+C_API AUSample const* au_audio_block_samples(AUAudioManager* audio, AUAudioID id, i64 frame, u16 channel)
 {
     VERIFY(channel < au_audio_channel_max);
     if (id.hash == au_audio_id_null.hash)
-        return 0; // Not ready.
+        return nullptr; // Not ready.
 
     au_audio_prefetch(audio, id, frame + 0 * au_audio_frames_per_block, channel);
     au_audio_prefetch(audio, id, frame + 1 * au_audio_frames_per_block, channel);
     if (frame < 0)
-        return 0;
+        return nullptr;
 
     auto block_id = au_audio_block_id(id, frame, channel);
-    auto slot = block_slot(block_id);
-    auto* block = &audio->blocks[slot];
+    auto* block = &audio->blocks[block_slot(block_id)];
     if (!block_equal(block->id, block_id))
-        return 0; // Not ready
-    u64 sample_slot = ((u64)frame) % au_audio_frames_per_block;
-    return block->samples[sample_slot];
+        return nullptr; // Not ready
+    return block->samples;
+}
+
+u64 AUAudioManager::frame_count(AUAudioID id) { return au_audio_frame_count(this, id); }
+C_API u64 au_audio_frame_count(AUAudioManager* audio, AUAudioID id)
+{
+    if (id.hash == au_audio_id_null.hash)
+        return 0; // Not ready.
+    auto* slot = &audio->audios[path_slot(id)];
+    if (slot->id.hash != id.hash)
+        return 0; // Not ready.
+    return slot->audio.frame_count;
 }
 
 static u16 block_slot(AUAudioBlockID block)
@@ -241,7 +259,11 @@ static u16 path_slot(AUAudioID id)
                 u64 relative_frame = 0;
                 u16 channel = prepare.id.channel;
                 for (u64 absolute_frame = sample_start; absolute_frame < sample_end; absolute_frame++, relative_frame++) {
+#if AU_SAMPLE_F32
+                    block->samples[relative_frame] = au_audio_sample_f32(&slot->audio, channel, absolute_frame);
+#else
                     block->samples[relative_frame] = au_audio_sample_f64(&slot->audio, channel, absolute_frame);
+#endif
                 }
                 write_barrier();
                 block->id = prepare.id;
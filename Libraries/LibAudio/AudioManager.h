@@ -12,6 +12,19 @@
 #include <LibThread/Thread.h>
 #include <sys/syslimits.h>
 
+// NOTE: Internal sample type of everything from the block cache to the
+//       device, build with -DAU_SAMPLE_F32=1 to mix in f32 for twice the
+//       SIMD width and half the memory traffic.
+#ifndef AU_SAMPLE_F32
+#define AU_SAMPLE_F32 0
+#endif
+
+#if AU_SAMPLE_F32
+typedef f32 AUSample;
+#else
+typedef f64 AUSample;
+#endif
+
 constexpr i64 au_audio_frames_per_block = 512;
 constexpr u64 au_audio_block_max = 16384;
 constexpr u64 au_audio_channel_max = 24;
@@ -32,7 +45,7 @@ typedef struct {
 } AUAudioBlockID;
 
 typedef struct {
-    f64 samples[au_audio_frames_per_block];
+    AUSample samples[au_audio_frames_per_block];
     AUAudioBlockID id; // FIXME: Make this atomic
 } AUAudioBlock;
 
@@ -61,7 +74,9 @@ typedef struct AUAudioManager {
     static AUAudioBlockID block(AUAudioID, u64 frame, u16 channel);
 
     void prefetch(AUAudioID, i64 frame, u16 channel);
-    f64 sample(AUAudioID, i64 frame, u16 channel);
+    AUSample sample(AUAudioID, i64 frame, u16 channel);
+    AUSample const* block_samples(AUAudioID, i64 frame, u16 channel);
+    u64 frame_count(AUAudioID);
 #endif
 } AUAudioManager;
 static_assert(sizeof(AUAudioManager) <= 96 * MiB);
@@ -74,4 +89,10 @@ C_API AUAudioID au_audio_id(AUAudioManager*, StringSlice file_name);
 C_API AUAudioBlockID au_audio_block_id(AUAudioID audio, u64 frame, u16 channel);
 
 C_API void au_audio_prefetch(AUAudioManager*, AUAudioID, i64 frame, u16 channel);
-C_API f64 au_audio_sample(AUAudioManager*, AUAudioID, i64 frame, u16 channel);
+C_API AUSample au_audio_sample(AUAudioManager*, AUAudioID, i64 frame, u16 channel);
+
+// NOTE: The au_audio_frames_per_block samples of the block holding frame,
+//       nullptr if it is not ready. Prefetches the block after it, so
+//       callers walking forward fetch once per block instead of per frame.
+C_API AUSample const* au_audio_block_samples(AUAudioManager*, AUAudioID, i64 frame, u16 channel);
+C_API u64 au_audio_frame_count(AUAudioManager*, AUAudioID); // 0 if not ready.
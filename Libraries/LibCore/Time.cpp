@@ -35,3 +35,10 @@ C_API f64 core_time_since_unspecified_epoch()
         return DBL_EPSILON;
     return time_since_start;
 }
+
+C_API u64 core_time_monotonic_ns()
+{
+    struct timespec now;
+    (void)clock_gettime(CLOCK_MONOTONIC, &now);
+    return (u64)now.tv_sec * 1000000000 + (u64)now.tv_nsec;
+}
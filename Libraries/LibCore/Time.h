@@ -59,3 +59,7 @@ static consteval struct timespec operator ""_ms(unsigned long long value)
 
 C_API f64 core_time_now();
 C_API f64 core_time_since_unspecified_epoch();
+
+// NOTE: CLOCK_MONOTONIC in whole nanoseconds, for measuring intervals too
+//       short for the f64 seconds above to resolve.
+C_API u64 core_time_monotonic_ns();
@@ -0,0 +1,120 @@
+#include "./DelayCompensation.h"
+
+#include <LibTy/Verify.h>
+
+#include <string.h>
+
+namespace MS {
+
+static u32 line_capacity_for(u32 delay);
+
+ErrorOr<DelayCompensation> DelayCompensation::create(Allocator* gpa, u32 track_count, u32 channel_count)
+{
+    auto compensation = DelayCompensation();
+    compensation.m_gpa = gpa;
+    compensation.m_channel_count = channel_count;
+
+    auto* lines = gpa->alloc<Line>(track_count);
+    if (!lines) return Error::from_string_literal("could not allocate delay lines");
+    for (u32 i = 0; i < track_count; i++)
+        lines[i] = Line();
+    compensation.m_lines = View(lines, track_count);
+
+    return compensation;
+}
+
+void DelayCompensation::destroy()
+{
+    for (auto& line : m_lines) {
+        if (line.samples)
+            m_gpa->free(line.samples, (u64)line.capacity * m_channel_count);
+        line = Line();
+    }
+    if (m_lines.data())
+        m_gpa->free(m_lines.data(), m_lines.size());
+    m_lines = {};
+    m_max_latency = 0;
+}
+
+ErrorOr<void> DelayCompensation::update(View<u32> track_latencies)
+{
+    if (track_latencies.size() != m_lines.size())
+        return Error::from_string_literal("track count does not match delay lines");
+
+    u32 max_latency = 0;
+    for (u32 latency : track_latencies) {
+        if (latency > max_latency)
+            max_latency = latency;
+    }
+
+    for (usize track = 0; track < m_lines.size(); track++) {
+        auto& line = m_lines[track];
+        u32 delay = max_latency - track_latencies[track];
+        line.latency = track_latencies[track];
+        if (delay == line.delay)
+            continue;
+
+        if (delay >= line.capacity) {
+            u32 capacity = line_capacity_for(delay);
+            auto* samples = m_gpa->alloc<f64>((u64)capacity * m_channel_count);
+            if (!samples) return Error::from_string_literal("could not allocate delay line");
+            if (line.samples)
+                m_gpa->free(line.samples, (u64)line.capacity * m_channel_count);
+            line.samples = samples;
+            line.capacity = capacity;
+        }
+
+        // NOTE: The old contents were aligned for the old delay, replaying
+        //       them would smear the transition, so start from silence.
+        if (line.samples)
+            memset(line.samples, 0, (u64)line.capacity * m_channel_count * sizeof(f64));
+        line.delay = delay;
+        line.head = 0;
+    }
+    m_max_latency = max_latency;
+
+    return {};
+}
+
+void DelayCompensation::clear()
+{
+    for (auto& line : m_lines) {
+        if (line.samples)
+            memset(line.samples, 0, (u64)line.capacity * m_channel_count * sizeof(f64));
+        line.head = 0;
+    }
+}
+
+void DelayCompensation::process(u32 track, f64* const* channels, u32 channel_count, u32 frames)
+{
+    auto& line = m_lines[track];
+    if (line.delay == 0)
+        return;
+
+    VERIFY(channel_count <= m_channel_count);
+    u32 mask = line.capacity - 1;
+    for (u32 channel = 0; channel < channel_count; channel++) {
+        f64* history = &line.samples[(u64)channel * line.capacity];
+        f64* samples = channels[channel];
+        u32 head = line.head;
+        for (u32 frame = 0; frame < frames; frame++) {
+            f64 delayed = history[(head - line.delay) & mask];
+            history[head & mask] = samples[frame];
+            samples[frame] = delayed;
+            head += 1;
+        }
+    }
+    line.head = (line.head + frames) & mask;
+}
+
+static u32 line_capacity_for(u32 delay)
+{
+    // NOTE: Power of two so the read and write index can wrap with a mask,
+    //       strictly larger than delay so a write never clobbers the read.
+    u32 capacity = 64;
+    while (capacity <= delay)
+        capacity *= 2;
+    return capacity;
+}
+
+}
@@ -0,0 +1,45 @@
+#pragma once
+#include <Basic/Allocator.h>
+#include <LibTy/ErrorOr.h>
+#include <LibTy/View.h>
+
+namespace MS {
+
+// NOTE: Every track is delayed by (largest track latency - own latency), so
+//       all paths line up when they are summed into the master bus. A track's
+//       latency is the sum of the latency() of the plugins in its chain.
+struct DelayCompensation {
+    static ErrorOr<DelayCompensation> create(Allocator* gpa, u32 track_count, u32 channel_count);
+    void destroy();
+
+    // NOTE: Not real time safe, call this when the graph changes (plugins
+    //       added, removed or reporting new latency), never while process()
+    //       may run. Lines only reallocate when their delay outgrows them.
+    ErrorOr<void> update(View<u32> track_latencies);
+
+    // NOTE: Not real time safe, silences every line without changing delays.
+    void clear();
+
+    // NOTE: Real time safe, delays channels[0..channel_count) in place.
+    //       channel_count is at most the one given to create().
+    void process(u32 track, f64* const* channels, u32 channel_count, u32 frames);
+
+    u32 total_latency() const { return m_max_latency; }
+    u32 track_delay(u32 track) const { return m_lines[track].delay; }
+
+private:
+    struct Line {
+        f64* samples { nullptr }; // Planar, capacity frames per channel.
+        u32 capacity { 0 };       // Power of two.
+        u32 latency { 0 };
+        u32 delay { 0 };
+        u32 head { 0 };
+    };
+
+    Allocator* m_gpa { nullptr };
+    View<Line> m_lines {};
+    u32 m_channel_count { 0 };
+    u32 m_max_latency { 0 };
+};
+
+}
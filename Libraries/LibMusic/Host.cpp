@@ -445,7 +445,10 @@ bool Host::process_events(Vst::Events* events)
 
 bool Host::io_changed()
 {
-    return false;
+    // NOTE: Plugins update initial_delay before calling this, the owner
+    //       re-reads it through Plugin::take_latency_changed().
+    __c11_atomic_store(&latency_changed, true, __ATOMIC_RELEASE);
+    return true;
 }
 
 bool Host::resize_window(i32 x, i32 y)
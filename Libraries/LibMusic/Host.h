@@ -39,6 +39,7 @@ struct Host {
     u32 sample_rate;
     u32 block_size;
     bool effect_is_initialized { false };
+    _Atomic bool latency_changed { false }; // Set when the plugin reports new io, possibly from the audio thread, cleared by whoever re-reads it.
     Vst::TimeInfo time_info;
 
     SmallCapture<void(i32, i32)> on_resize { nullptr };
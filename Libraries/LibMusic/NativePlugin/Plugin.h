@@ -11,6 +11,9 @@ extern void ms_plugin_process_f32(MSPluginHost const*, f32* out, f32 const* in,
 extern void ms_plugin_init(MSPluginHost const* host);
 extern void ms_plugin_deinit(MSPluginHost const* host);
 
+// Optional, frames of delay between input and output.
+extern u32 ms_plugin_latency(MSPluginHost const* host);
+
 #ifdef __cplusplus
 }
 #endif
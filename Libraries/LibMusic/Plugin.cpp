@@ -29,6 +29,11 @@ Plugin::Plugin(usize id, MS::PluginManager const* manager, Library* lib)
         }).or_else([&] {
             return library_get_symbol(lib, "native_plugin_deinit");
         }),
+        .latency = (decltype(Client::latency))optional([&] {
+            return library_get_symbol(lib, "_native_plugin_latency");
+        }).or_else([&] {
+            return library_get_symbol(lib, "native_plugin_latency");
+        }),
     })
 {
 }
@@ -62,6 +67,14 @@ void Plugin::process_f32(f32* out, f32 const* in, u32 frames)
     }
 }
 
+u32 Plugin::latency() const
+{
+    if (m_client.latency) {
+        return m_client.latency(&m_host);
+    }
+    return 0;
+}
+
 void Plugin::log_err(MSPluginHost const* host, c_string fmt, ...)
 {
     auto const* plugin = (Plugin const*)host;
@@ -19,6 +19,8 @@ struct Plugin {
     bool can_process_f32() const { return m_client.process_f32 != nullptr; }
     bool can_process_f64() const { return m_client.process_f64 != nullptr; }
 
+    u32 latency() const;
+
 private:
     struct Client {
         decltype(ms_plugin_name)* name = nullptr;
@@ -26,6 +28,7 @@ private:
         decltype(ms_plugin_process_f64)* process_f64 = nullptr;
         decltype(ms_plugin_init)* init = nullptr;
         decltype(ms_plugin_deinit)* deinit = nullptr;
+        decltype(ms_plugin_latency)* latency = nullptr;
     };
 
     Plugin(usize id, PluginManager const* manager, Client client);
@@ -112,6 +112,16 @@ struct Plugin {
         return vst->vst_magic;
     }
 
+    u32 latency() const
+    {
+        return vst->initial_delay > 0 ? (u32)vst->initial_delay : 0;
+    }
+
+    [[nodiscard]] bool take_latency_changed()
+    {
+        return __c11_atomic_exchange(&host->latency_changed, false, __ATOMIC_ACQUIRE);
+    }
+
     u32 number_of_parameters() const
     {
         return vst->number_of_parameters;
@@ -230,6 +230,19 @@ ErrorOr<void> WASMPlugin::link()
         return Error::from_string_literal("either ms_plugin_process_f32 or ms_plugin_process_f64 needs to be defined");
     }
 
+    if (!func.latency) {
+        if (c_string res = m3_FindFunction(&func.latency, runtime, "ms_plugin_latency")) {
+            if (res != m3Err_functionLookupFailed) {
+                return Error::from_string_literal(res);
+            }
+        }
+        if (func.latency) {
+            if (!function_has_signature(func.latency, "i()")) {
+                return Error::from_string_literal("expected ms_plugin_latency to have signature u32(void)");
+            }
+        }
+    }
+
     if (!func.parameter_count) {
         if (c_string res = m3_FindFunction(&func.parameter_count, runtime, "ms_plugin_parameter_count")) {
             if (res != m3Err_functionLookupFailed) {
@@ -506,6 +519,19 @@ bool WASMPlugin::can_process_f64() const
     return func.process_f64 != nullptr;
 }
 
+ErrorOr<u32> WASMPlugin::latency() const
+{
+    if (!func.latency)
+        return 0;
+    u32 result = 0;
+    if (c_string res = m3_CallV(func.latency)) {
+        return Error::from_string_literal(res);
+    }
+    if (c_string res = m3_GetResultsV(func.latency, &result)) {
+        return Error::from_string_literal(res);
+    }
+    return result;
+}
 
 ErrorOr<u32> WASMPlugin::parameter_count() const
 {
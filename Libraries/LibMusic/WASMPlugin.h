@@ -18,6 +18,7 @@ struct WASMPlugin {
         IM3Function deinit { nullptr };
         IM3Function process_f32 { nullptr };
         IM3Function process_f64 { nullptr };
+        IM3Function latency { nullptr };
 
         IM3Function parameter_count { nullptr };
         IM3Function get_parameter { nullptr };
@@ -50,6 +51,15 @@ struct WASMPlugin {
     bool can_process_f32() const;
     bool can_process_f64() const;
 
+    // NOTE: Lets hosts call with their internal sample type without a conversion pass.
+    ErrorOr<void> process(f32* out, f32 const* in, u32 frames, u32 channels) const { return process_f32(out, in, frames, channels); }
+    ErrorOr<void> process(f64* out, f64 const* in, u32 frames, u32 channels) const { return process_f64(out, in, frames, channels); }
+    bool can_process(f32 const*) const { return can_process_f32(); }
+    bool can_process(f64 const*) const { return can_process_f64(); }
+
+    // NOTE: Frames of delay the plugin adds to its output, 0 if the plugin does not say.
+    ErrorOr<u32> latency() const;
+
     ErrorOr<u32> parameter_count() const;
     ErrorOr<f64> parameter(u32 id) const;
     ErrorOr<void> set_parameter(u32 id, f64 value) const;
@@ -68,6 +68,12 @@ void ms_plugin_draw_ui(void) __asm__("ms_plugin_draw_ui");
 void ms_plugin_process_f32(f32* out, f32 const* in, u32 frames, u32 channels) __asm__("ms_plugin_process_f32");
 void ms_plugin_process_f64(f64* out, f64 const* in, u32 frames, u32 channels) __asm__("ms_plugin_process_f64");
 
+// Optional, frames of delay between input and output (lookahead, linear phase
+// filters, ...). Hosts that sum tracks delay the others to match, see
+// MS::DelayCompensation.
+// NOTE: Queried again when the track graph changes, not per block.
+u32 ms_plugin_latency(void) __asm__("ms_plugin_latency");
+
 typedef char const* MSPluginParameterKind;
 #define MSPluginParameterKind_Knob    ("com.music-studio.knob")
 #define MSPluginParameterKind_Toggle  ("com.music-studio.toggle")
@@ -7,9 +7,52 @@
 
 #include <unistd.h>
 #include <errno.h>
+#include <pthread.h>
+
+// NOTE: Roughly a microsecond, about as long as handing work to a parked
+//       worker and back takes.
+static constexpr u32 spin_count = 256;
+static constexpr u32 thread_queue_max = 4;
+
+typedef struct {
+    THDispatchQueue* queue;
+    THDispatchDeque* deque;
+    u64* steal_seed;
+    u64 worker_id;
+    u32 external_slot;
+    bool is_worker;
+} Self;
+
+static thread_local Self t_selves[thread_queue_max];
+static thread_local THDispatchQueue* t_overflow_queue; // Whose overflow lock this thread holds.
+static pthread_once_t selves_key_once = PTHREAD_ONCE_INIT;
+static pthread_key_t selves_key;
 
 static void dispatch_thread(void*);
 
+static Self* self_for(THDispatchQueue*);
+static u32 claim_external(THDispatchQueue*);
+static void release_selves(void*);
+static void create_selves_key(void);
+static void submit(THDispatchQueue*, THDispatchWork);
+static void push_work(THDispatchQueue*, THDispatchWork);
+static void run(THDispatchQueue*, Self*, THDispatchWork);
+static void release_group(THDispatchQueue*, THDispatchGroup*, u64 count);
+static bool find_work(THDispatchQueue*, Self*, THDispatchGroup const* only, THDispatchWork* out);
+static bool has_work(THDispatchQueue*, THDispatchGroup const* only);
+static THDispatchDeque* victim_deque(THDispatchQueue*, u64 victim);
+static void wake_one(THDispatchQueue*);
+static bool take_one(_Atomic u32*);
+static void wake_all(_Atomic u32*, THSemaphore*);
+static void then_lock(THDispatchGroup*);
+static void then_unlock(THDispatchGroup*);
+static void cpu_relax(void);
+
+static bool deque_push(THDispatchDeque*, THDispatchWork);
+static bool deque_pop(THDispatchDeque*, THDispatchWork* out);
+static bool deque_steal(THDispatchDeque*, THDispatchGroup const* only, THDispatchWork* out);
+static bool deque_has_work(THDispatchDeque*, THDispatchGroup const* only);
+
 C_API KError th_dispatch_queue_init(THDispatchQueue* q, c_string name)
 {
     if (!C_ASSERT(q != nullptr)) return kerror_unix(EINVAL);
@@ -19,21 +62,28 @@ C_API KError th_dispatch_queue_init(THDispatchQueue* q, c_string name)
 
     i64 worker_count = sysconf(_SC_NPROCESSORS_ONLN);
     if (worker_count < 0) return kerror_unix(errno);
-    if (!C_ASSERT(worker_count < ARRAY_SSIZE(q->workers))) {
-        worker_count = ARRAY_SIZE(q->workers) - 1;
+    if (!C_ASSERT(worker_count <= ARRAY_SSIZE(q->workers))) {
+        worker_count = ARRAY_SIZE(q->workers);
     }
 
     q->worker_count = (u64)worker_count;
+    th_sem_init(&q->work_available, 0);
+    th_sem_init(&q->completed, 0);
+    th_sem_init(&q->overflow, 1);
+    for (u32 i = 0; i < th_dispatch_external_max; i++)
+        q->externals[i].steal_seed = 0x9E3779B97F4A7C15 * (i + 1);
 
     for (i64 i = 0; i < worker_count; i++) {
         THDispatchWorker* worker = &q->workers[i];
         worker->worker_id = i + 1;
+        worker->queue = q;
+        worker->steal_seed = 0xBF58476D1CE4E5B9 * (u64)(i + 1);
         TRY(th_thread_init(&worker->thread, name, (Context){}, worker, dispatch_thread));
-        th_sem_init(&worker->there_is_work, 0);
-        th_sem_init(&worker->completed_work, 0);
     }
 
     q->version = sizeof(*q);
+    for (u64 i = 0; i < q->worker_count; i++)
+        th_thread_start(&q->workers[i].thread);
     return kerror_none;
 }
 
@@ -42,59 +92,522 @@ C_API void th_dispatch_queue(THDispatchQueue* q, void* user1, void* user2, u64 s
     if (!C_ASSERT(q)) return;
     if (!C_ASSERT(ty_is_initialized(q))) return;
     if (!C_ASSERT(batch_size > 0)) return;
+    if (size == 0) return;
 
-    for (u64 i = 0; i < size; i += batch_size) {
-        u64 worker_id = q->robin++ % q->worker_count;
-        THDispatchWorker* worker = &q->workers[worker_id];
-        THDispatchWork work = {
-            .start = i,
-            .end = i + batch_size < size ? i + batch_size : size,
-            .user1 = user1,
-            .user2 = user2,
-            .callback = callback,
-        };
-        u64 size_left = ARRAY_SIZE(worker->queue) - (worker->work_count - worker->done_count);
-        if (size_left >= 1) {
-            th_thread_start(&worker->thread);
-            worker->queue[worker->work_count++ % ARRAY_SIZE(worker->queue)] = work;
-            th_sem_signal(&worker->there_is_work);
-        } else {
-            callback(0, user1, user2, work.start, work.end);
+    submit(q, (THDispatchWork){
+        .start = 0,
+        .end = size,
+        .grain = batch_size,
+        .user1 = user1,
+        .user2 = user2,
+        .callback = callback,
+        .group = nullptr,
+    });
+}
+
+C_API void th_dispatch_for(THDispatchQueue* q, void* user1, void* user2, u64 size, void(*callback)(u64 worker, void* user1, void* user2, u64 begin, u64 end))
+{
+    if (!C_ASSERT(q)) return;
+    if (!C_ASSERT(ty_is_initialized(q))) return;
+    if (size == 0) return;
+
+    // NOTE: A few ranges per thread, so a thread that falls behind has
+    //       something left to be stolen from it.
+    u64 grain = size / ((q->worker_count + 1) * 4);
+
+    THDispatchGroup group;
+    th_dispatch_group_init(&group);
+    th_dispatch_group_async(q, &group, user1, user2, size, grain ? grain : 1, callback);
+    th_dispatch_group_wait(q, &group);
+    th_dispatch_group_deinit(&group);
+}
+
+C_API void th_dispatch_sync(THDispatchQueue* q)
+{
+    if (!C_ASSERT(q)) return;
+    if (!C_ASSERT(ty_is_initialized(q))) return;
+
+    Self* self = self_for(q);
+    while (q->pending != 0) {
+        THDispatchWork work;
+        if (self && find_work(q, self, nullptr, &work)) {
+            run(q, self, work);
+            continue;
+        }
+        // NOTE: Same handshake as group waits, run() sees syncing once
+        //       pending reaches zero and wakes everyone parked here.
+        q->syncing += 1;
+        if (q->pending == 0 || (self && has_work(q, nullptr))) {
+            (void)take_one(&q->syncing);
+            continue;
         }
+        (void)th_sem_wait(&q->completed);
     }
 }
 
-C_API void th_dispatch_sync(THDispatchQueue* q)
+C_API void th_dispatch_group_init(THDispatchGroup* group)
+{
+    MEMZERO(group);
+    th_sem_init(&group->done, 0);
+    group->version = sizeof(*group);
+}
+
+C_API void th_dispatch_group_deinit(THDispatchGroup* group)
+{
+    if (!ty_is_initialized(group)) return;
+    VERIFY(group->pending == 0);
+    th_sem_deinit(&group->done);
+    MEMZERO(group);
+}
+
+C_API void th_dispatch_group_async(THDispatchQueue* q, THDispatchGroup* group, void* user1, void* user2, u64 size, u64 batch_size, void(*callback)(u64 worker, void* user1, void* user2, u64 begin, u64 end))
 {
     if (!C_ASSERT(q)) return;
     if (!C_ASSERT(ty_is_initialized(q))) return;
+    if (!C_ASSERT(ty_is_initialized(group))) return;
+    if (!C_ASSERT(batch_size > 0)) return;
+    if (size == 0) return;
 
-    for (u64 i = 0; i < q->worker_count; i++) {
-        THDispatchWorker* worker = &q->workers[i];
-        while (worker->done_count != worker->work_count) {
-            KError err = th_sem_wait(&worker->completed_work);
-            if (!err.ok) continue;
+    submit(q, (THDispatchWork){
+        .start = 0,
+        .end = size,
+        .grain = batch_size,
+        .user1 = user1,
+        .user2 = user2,
+        .callback = callback,
+        .group = group,
+    });
+}
+
+C_API void th_dispatch_group_then(THDispatchQueue* q, THDispatchGroup* after, THDispatchGroup* into, void* user1, void* user2, u64 size, u64 batch_size, void(*callback)(u64 worker, void* user1, void* user2, u64 begin, u64 end))
+{
+    if (!C_ASSERT(q)) return;
+    if (!C_ASSERT(ty_is_initialized(q))) return;
+    if (!C_ASSERT(ty_is_initialized(after))) return;
+    if (!C_ASSERT(ty_is_initialized(into))) return;
+    if (!C_ASSERT(after != into)) return;
+    if (!C_ASSERT(batch_size > 0)) return;
+    if (size == 0) return;
+
+    THDispatchWork work = {
+        .start = 0,
+        .end = size,
+        .grain = batch_size,
+        .user1 = user1,
+        .user2 = user2,
+        .callback = callback,
+        .group = into,
+    };
+    q->pending += size;
+    into->pending += size;
+
+    // NOTE: release_group() takes the list under the same lock after pending
+    //       reaches zero, so the work is either seen there or submitted here.
+    then_lock(after);
+    bool is_done = after->pending == 0;
+    bool is_queued = !is_done && after->then_count < th_dispatch_then_max;
+    if (is_queued)
+        after->then[after->then_count++] = work;
+    then_unlock(after);
+    if (is_queued)
+        return;
+
+    if (!is_done)
+        th_dispatch_group_wait(q, after);
+    push_work(q, work);
+}
+
+C_API void th_dispatch_group_wait(THDispatchQueue* q, THDispatchGroup* group)
+{
+    if (!C_ASSERT(q)) return;
+    if (!C_ASSERT(ty_is_initialized(q))) return;
+    if (!C_ASSERT(ty_is_initialized(group))) return;
+
+    Self* self = self_for(q);
+    THDispatchGroup const* only = self && self->is_worker ? nullptr : group;
+    u32 spins = 0;
+    for (;;) {
+        if (group->pending == 0) {
+            // NOTE: The last task may still be handing off continuations or
+            //       signalling, the group must outlive that.
+            while (group->releasing != 0)
+                cpu_relax();
+            return;
         }
+
+        THDispatchWork work;
+        if (self && find_work(q, self, only, &work)) {
+            run(q, self, work);
+            spins = 0;
+            continue;
+        }
+        if (spins < spin_count) {
+            spins += 1;
+            cpu_relax();
+            continue;
+        }
+
+        group->waiting += 1;
+        if (group->pending == 0 || has_work(q, only)) {
+            // NOTE: If a releaser got here first its signal stays counted
+            //       and only makes a later park return early.
+            (void)take_one(&group->waiting);
+            continue;
+        }
+        (void)th_sem_wait(&group->done);
+        spins = 0;
     }
 }
 
 static void dispatch_thread(void* ptr)
 {
-    THDispatchWorker* ctx = (THDispatchWorker*)ptr;
+    THDispatchWorker* worker = (THDispatchWorker*)ptr;
+    THDispatchQueue* q = worker->queue;
+    t_selves[0] = (Self){
+        .queue = q,
+        .deque = &worker->deque,
+        .steal_seed = &worker->steal_seed,
+        .worker_id = worker->worker_id,
+        .is_worker = true,
+    };
+    Self* self = &t_selves[0];
 
     for (;;) {
         reset_temporary_arena();
-        KError err = th_sem_wait(&ctx->there_is_work);
-        if (!err.ok) continue;
-        VERIFY(ctx->done_count < ctx->work_count);
-        u64 index = ctx->done_count % ARRAY_SIZE(ctx->queue);
-        THDispatchWork work = ctx->queue[index];
-        if (!C_ASSERT(work.callback != nullptr));
-        else work.callback(ctx->worker_id, work.user1, work.user2, work.start, work.end);
-        work.callback = nullptr;
-        ctx->done_count++;
-        th_sem_signal(&ctx->completed_work);
+
+        THDispatchWork work;
+        if (find_work(q, self, nullptr, &work)) {
+            run(q, self, work);
+            continue;
+        }
+
+        // NOTE: Announce before the last look, a push that lands after the
+        //       look sees sleeping and signals, so no wake up is lost.
+        q->sleeping += 1;
+        if (has_work(q, nullptr)) {
+            (void)take_one(&q->sleeping);
+            continue;
+        }
+        (void)th_sem_wait(&q->work_available);
     }
 
     UNREACHABLE();
 }
+
+static Self* self_for(THDispatchQueue* q)
+{
+    for (u32 i = 0; i < thread_queue_max; i++) {
+        if (t_selves[i].queue == q)
+            return &t_selves[i];
+    }
+    for (u32 i = 0; i < thread_queue_max; i++) {
+        if (t_selves[i].queue != nullptr)
+            continue;
+        u32 slot = claim_external(q);
+        if (slot >= th_dispatch_external_max)
+            return nullptr;
+        t_selves[i] = (Self){
+            .queue = q,
+            .deque = &q->externals[slot].deque,
+            .steal_seed = &q->externals[slot].steal_seed,
+            .worker_id = slot == 0 ? 0 : q->worker_count + slot,
+            .external_slot = slot,
+            .is_worker = false,
+        };
+        pthread_once(&selves_key_once, create_selves_key);
+        VERIFY(pthread_setspecific(selves_key, t_selves) == 0);
+        return &t_selves[i];
+    }
+    return nullptr;
+}
+
+static u32 claim_external(THDispatchQueue* q)
+{
+    u32 used = __c11_atomic_load(&q->externals_in_use, __ATOMIC_RELAXED);
+    for (;;) {
+        // NOTE: A slot given back with work still queued stays out of reach
+        //       until the pool has stolen it all, only the owner may push.
+        u32 claimable = 0;
+        for (u32 slot = 0; slot < th_dispatch_external_max; slot++) {
+            if (used & (1u << slot)) continue;
+            if (deque_has_work(&q->externals[slot].deque, nullptr)) continue;
+            claimable |= 1u << slot;
+        }
+        if (claimable == 0)
+            return th_dispatch_external_max;
+        u32 slot = (u32)__builtin_ctz(claimable);
+        if (__c11_atomic_compare_exchange_weak(&q->externals_in_use, &used, used | (1u << slot), __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+            return slot;
+    }
+}
+
+static void release_selves(void* value)
+{
+    Self* selves = (Self*)value;
+    for (u32 i = 0; i < thread_queue_max; i++) {
+        Self* self = &selves[i];
+        if (!self->queue || self->is_worker)
+            continue;
+        // NOTE: Whatever is left in the deque is handed off to the pool,
+        //       thieves drain it before the slot can be claimed again.
+        THDispatchQueue* q = self->queue;
+        if (deque_has_work(self->deque, nullptr))
+            wake_one(q);
+        __c11_atomic_fetch_and(&q->externals_in_use, ~(1u << self->external_slot), __ATOMIC_RELEASE);
+        *self = (Self){};
+    }
+}
+
+static void create_selves_key(void)
+{
+    VERIFY(pthread_key_create(&selves_key, release_selves) == 0);
+}
+
+static void submit(THDispatchQueue* q, THDispatchWork work)
+{
+    q->pending += work.end - work.start;
+    if (work.group)
+        work.group->pending += work.end - work.start;
+    push_work(q, work);
+}
+
+static void push_work(THDispatchQueue* q, THDispatchWork work)
+{
+    Self* self = self_for(q);
+    if (!self) {
+        // NOTE: Out of external slots, run it here under the one id kept for
+        //       this, serialized so callbacks never share a worker id.
+        //       Work submitted from inside is run in place as well.
+        bool is_outermost = t_overflow_queue != q;
+        if (is_outermost) {
+            (void)th_sem_wait(&q->overflow);
+            t_overflow_queue = q;
+        }
+        Self inline_self = {
+            .queue = q,
+            .deque = nullptr,
+            .steal_seed = nullptr,
+            .worker_id = q->worker_count + th_dispatch_external_max,
+            .is_worker = false,
+        };
+        run(q, &inline_self, work);
+        if (is_outermost) {
+            t_overflow_queue = nullptr;
+            th_sem_signal(&q->overflow);
+        }
+        return;
+    }
+    if (!deque_push(self->deque, work)) {
+        run(q, self, work);
+        return;
+    }
+    wake_one(q);
+}
+
+static void run(THDispatchQueue* q, Self* self, THDispatchWork work)
+{
+    // NOTE: Keep the lower half and offer the upper half to thieves until
+    //       the range is down to the grain. Whoever steals a half splits it
+    //       again, so idle workers pick up large ranges first.
+    while (self->deque && work.end - work.start > work.grain) {
+        THDispatchWork upper = work;
+        upper.start = work.start + (work.end - work.start) / 2;
+        if (!deque_push(self->deque, upper))
+            break;
+        wake_one(q);
+        work.end = upper.start;
+    }
+
+    if (!C_ASSERT(work.callback != nullptr));
+    else work.callback(self->worker_id, work.user1, work.user2, work.start, work.end);
+
+    // NOTE: The group goes first, continuations it submits are counted in
+    //       the queue before this work stops being counted.
+    u64 count = work.end - work.start;
+    if (work.group)
+        release_group(q, work.group, count);
+    if ((q->pending -= count) == 0)
+        wake_all(&q->syncing, &q->completed);
+}
+
+static void release_group(THDispatchQueue* q, THDispatchGroup* group, u64 count)
+{
+    group->releasing += 1;
+    if ((group->pending -= count) != 0) {
+        group->releasing -= 1;
+        return;
+    }
+
+    then_lock(group);
+    u32 then_count = group->then_count;
+    THDispatchWork then[th_dispatch_then_max];
+    for (u32 i = 0; i < then_count; i++)
+        then[i] = group->then[i];
+    group->then_count = 0;
+    then_unlock(group);
+
+    for (u32 i = 0; i < then_count; i++)
+        push_work(q, then[i]);
+    wake_all(&group->waiting, &group->done);
+    group->releasing -= 1;
+}
+
+static bool find_work(THDispatchQueue* q, Self* self, THDispatchGroup const* only, THDispatchWork* out)
+{
+    if (deque_pop(self->deque, out)) {
+        if (!only || out->group == only)
+            return true;
+        // NOTE: Not ours to run, the owner is the only one who pushes, so
+        //       putting it back cannot fail.
+        VERIFY(deque_push(self->deque, *out));
+    }
+    // NOTE: Our own ranges can sit under someone else's, take them from the
+    //       top like a thief would, has_work() looks there too.
+    if (only && deque_steal(self->deque, only, out))
+        return true;
+
+    // NOTE: Start at a random victim so thieves spread out instead of all
+    //       hammering the first busy deque.
+    u64* seed = self->steal_seed;
+    *seed ^= *seed << 13;
+    *seed ^= *seed >> 7;
+    *seed ^= *seed << 17;
+    u64 victims = th_dispatch_external_max + q->worker_count;
+    u64 first = *seed % victims;
+    for (u64 i = 0; i < victims; i++) {
+        THDispatchDeque* deque = victim_deque(q, (first + i) % victims);
+        if (deque == self->deque) continue;
+        if (deque_steal(deque, only, out))
+            return true;
+    }
+    return false;
+}
+
+static bool has_work(THDispatchQueue* q, THDispatchGroup const* only)
+{
+    u64 victims = th_dispatch_external_max + q->worker_count;
+    for (u64 i = 0; i < victims; i++) {
+        if (deque_has_work(victim_deque(q, i), only))
+            return true;
+    }
+    return false;
+}
+
+static THDispatchDeque* victim_deque(THDispatchQueue* q, u64 victim)
+{
+    if (victim < th_dispatch_external_max)
+        return &q->externals[victim].deque;
+    return &q->workers[victim - th_dispatch_external_max].deque;
+}
+
+static void wake_one(THDispatchQueue* q)
+{
+    if (take_one(&q->sleeping))
+        th_sem_signal(&q->work_available);
+}
+
+static bool take_one(_Atomic u32* count)
+{
+    u32 value = *count;
+    while (value != 0) {
+        if (__c11_atomic_compare_exchange_weak(count, &value, value - 1, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST))
+            return true;
+    }
+    return false;
+}
+
+static void wake_all(_Atomic u32* count, THSemaphore* semaphore)
+{
+    while (take_one(count))
+        th_sem_signal(semaphore);
+}
+
+static void then_lock(THDispatchGroup* group)
+{
+    while (__c11_atomic_exchange(&group->then_lock, true, __ATOMIC_ACQUIRE))
+        cpu_relax();
+}
+
+static void then_unlock(THDispatchGroup* group)
+{
+    __c11_atomic_store(&group->then_lock, false, __ATOMIC_RELEASE);
+}
+
+static void cpu_relax(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    __builtin_arm_yield();
+#endif
+}
+
+static bool deque_push(THDispatchDeque* d, THDispatchWork work)
+{
+    i64 bottom = __c11_atomic_load(&d->bottom, __ATOMIC_RELAXED);
+    i64 top = __c11_atomic_load(&d->top, __ATOMIC_ACQUIRE);
+    if (bottom - top >= (i64)th_dispatch_deque_size)
+        return false;
+    d->items[bottom % th_dispatch_deque_size] = work;
+    __c11_atomic_thread_fence(__ATOMIC_RELEASE);
+    __c11_atomic_store(&d->bottom, bottom + 1, __ATOMIC_RELAXED);
+    // NOTE: Orders the push before the read of sleeping in wake_one().
+    __c11_atomic_thread_fence(__ATOMIC_SEQ_CST);
+    return true;
+}
+
+static bool deque_pop(THDispatchDeque* d, THDispatchWork* out)
+{
+    i64 bottom = __c11_atomic_load(&d->bottom, __ATOMIC_RELAXED) - 1;
+    __c11_atomic_store(&d->bottom, bottom, __ATOMIC_RELAXED);
+    __c11_atomic_thread_fence(__ATOMIC_SEQ_CST);
+    i64 top = __c11_atomic_load(&d->top, __ATOMIC_RELAXED);
+    if (top > bottom) {
+        __c11_atomic_store(&d->bottom, bottom + 1, __ATOMIC_RELAXED);
+        return false;
+    }
+
+    *out = d->items[bottom % th_dispatch_deque_size];
+    if (top != bottom)
+        return true;
+
+    // NOTE: Last item, race the thieves for it through top.
+    bool won = __c11_atomic_compare_exchange_strong(&d->top, &top, top + 1, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED);
+    __c11_atomic_store(&d->bottom, bottom + 1, __ATOMIC_RELAXED);
+    return won;
+}
+
+static bool deque_steal(THDispatchDeque* d, THDispatchGroup const* only, THDispatchWork* out)
+{
+    i64 top = __c11_atomic_load(&d->top, __ATOMIC_ACQUIRE);
+    __c11_atomic_thread_fence(__ATOMIC_SEQ_CST);
+    i64 bottom = __c11_atomic_load(&d->bottom, __ATOMIC_ACQUIRE);
+    if (top >= bottom)
+        return false;
+
+    // NOTE: The owner can only overwrite this slot after top has moved past
+    //       it, in which case the CAS below fails and the copy is dropped.
+    THDispatchWork work;
+    __builtin_memcpy(&work, (void const*)&d->items[top % th_dispatch_deque_size], sizeof(work));
+    if (only && work.group != only)
+        return false;
+    if (!__c11_atomic_compare_exchange_strong(&d->top, &top, top + 1, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED))
+        return false;
+    *out = work;
+    return true;
+}
+
+static bool deque_has_work(THDispatchDeque* d, THDispatchGroup const* only)
+{
+    i64 top = __c11_atomic_load(&d->top, __ATOMIC_ACQUIRE);
+    i64 bottom = __c11_atomic_load(&d->bottom, __ATOMIC_ACQUIRE);
+    if (top >= bottom)
+        return false;
+    if (!only)
+        return true;
+
+    // NOTE: Only the top is checked, the same item a steal would look at.
+    THDispatchWork work;
+    __builtin_memcpy(&work, (void const*)&d->items[top % th_dispatch_deque_size], sizeof(work));
+    return work.group == only;
+}
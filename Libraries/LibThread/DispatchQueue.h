@@ -2,33 +2,118 @@
 #include "./Thread.h"
 #include "./Semaphore.h"
 
+#include <Basic/Bits.h>
+
+// NOTE: Ranges are split in halves as they run, so a deque only ever holds
+//       about log2(size / grain) entries per submitted range.
+static constexpr u32 th_dispatch_deque_size = 256;
+static constexpr u32 th_dispatch_worker_max = 255;
+static constexpr u32 th_dispatch_external_max = 8;
+static constexpr u32 th_dispatch_then_max = 8;
+static_assert(th_dispatch_external_max <= 32);
+
+typedef struct THDispatchQueue THDispatchQueue;
+typedef struct THDispatchGroup THDispatchGroup;
+
 typedef struct THDispatchWork {
     u64 start;
     u64 end;
+    u64 grain; // Ranges longer than this are split before they run.
     void* user1;
     void* user2;
     void (*callback)(u64 worker, void* user1, void* user2, u64 begin, u64 end);
+    THDispatchGroup* group;
 } THDispatchWork;
 
+// NOTE: Counts the indices submitted into it that have not run yet, so a
+//       thread can wait for its own work without waiting on everyone
+//       else's. Groups can be reused once waited on.
+typedef struct THDispatchGroup {
+    u64 version;
+    _Atomic u64 pending;
+    _Atomic u32 releasing; // Threads still touching the group after pending hit zero.
+    _Atomic u32 waiting;
+    THSemaphore done;
+
+    // NOTE: Work to submit once pending reaches zero, see th_dispatch_group_then().
+    _Atomic bool then_lock;
+    u32 then_count;
+    THDispatchWork then[th_dispatch_then_max];
+} THDispatchGroup;
+
+// NOTE: Chase-Lev deque. The owner pushes and pops at bottom, any thread
+//       steals from top. A full deque makes the owner run work in place
+//       instead of growing, so submission never fails or blocks.
+typedef struct THDispatchDeque {
+    alignas(cache_line_size) _Atomic i64 top;
+    alignas(cache_line_size) _Atomic i64 bottom;
+    alignas(cache_line_size) THDispatchWork items[th_dispatch_deque_size];
+} THDispatchDeque;
+
 typedef struct THDispatchWorker {
     u64 worker_id;
     THThread thread;
-
-    THSemaphore there_is_work;
-    THSemaphore completed_work;
-    _Atomic u64 work_count;
-    _Atomic u64 done_count;
-    THDispatchWork queue[256];
+    THDispatchQueue* queue;
+    u64 steal_seed;
+    THDispatchDeque deque;
 } THDispatchWorker;
 
 typedef struct THDispatchQueue {
     u64 version;
-    u64 robin;
     u64 worker_count;
-    THDispatchWorker workers[256];
+
+    alignas(cache_line_size) _Atomic u64 pending; // Indices submitted and not yet run.
+    _Atomic u32 sleeping;
+    _Atomic u32 syncing; // Threads parked in th_dispatch_sync().
+    THSemaphore work_available;
+    THSemaphore completed;
+
+    // NOTE: Threads outside the pool get one of these the first time they
+    //       submit or wait, and give it back when they exit. Slot 0 runs as
+    //       worker 0, the rest as worker_count + slot. Threads that find
+    //       them all taken run their work in place, one at a time, as
+    //       worker_count + th_dispatch_external_max, so worker ids stay
+    //       below worker_count + th_dispatch_external_max + 1.
+    _Atomic u32 externals_in_use; // Bit per slot.
+    THSemaphore overflow; // Held while running work in place, parks instead of spinning.
+    struct {
+        u64 steal_seed;
+        THDispatchDeque deque;
+    } externals[th_dispatch_external_max];
+
+    THDispatchWorker workers[th_dispatch_worker_max];
 } THDispatchQueue;
-static_assert(sizeof(THDispatchQueue) == 2654232);
+static_assert(sizeof(THDispatchQueue) < 4 * MiB);
 
 C_API KError th_dispatch_queue_init(THDispatchQueue* queue, c_string name);
+
+// NOTE: Work can be submitted from any thread, including from inside a
+//       callback. batch_size is the smallest range a callback is given
+//       while there are idle workers to take the rest.
 C_API void th_dispatch_queue(THDispatchQueue*, void* user1, void* user2, u64 size, u64 batch_size, void(*)(u64 worker, void* user1, void* user2, u64 begin, u64 end));
+
+// NOTE: Waits for everything submitted to the queue, from any thread.
 C_API void th_dispatch_sync(THDispatchQueue*);
+
+C_API void th_dispatch_group_init(THDispatchGroup*);
+C_API void th_dispatch_group_deinit(THDispatchGroup*);
+
+C_API void th_dispatch_group_async(THDispatchQueue*, THDispatchGroup*, void* user1, void* user2, u64 size, u64 batch_size, void(*)(u64 worker, void* user1, void* user2, u64 begin, u64 end));
+
+// NOTE: Submits the work into `into` once `after` has no pending work left,
+//       right away if it already has none. `into` counts the work from now,
+//       so waiting on it also waits for `after`. A group holds at most
+//       th_dispatch_then_max continuations, past that this call waits on
+//       `after` itself before submitting.
+C_API void th_dispatch_group_then(THDispatchQueue*, THDispatchGroup* after, THDispatchGroup* into, void* user1, void* user2, u64 size, u64 batch_size, void(*)(u64 worker, void* user1, void* user2, u64 begin, u64 end));
+
+// NOTE: Spins, then parks, running the group's work while there is some.
+//       Threads outside the pool only run work from this group, so the
+//       audio thread never gets stuck in someone's background job. Pool
+//       threads waiting from inside a callback run anything, which is what
+//       keeps nested waits from starving each other.
+C_API void th_dispatch_group_wait(THDispatchQueue*, THDispatchGroup*);
+
+// NOTE: Parallel for over [0, size), picks the grain from size and worker
+//       count and returns once every index has run.
+C_API void th_dispatch_for(THDispatchQueue*, void* user1, void* user2, u64 size, void(*)(u64 worker, void* user1, void* user2, u64 begin, u64 end));
@@ -16,6 +16,13 @@ typedef struct [[gnu::packed]] Header {
     u8 data[];
 } Header;
 
+static KError check_writer(THMessageQueue*);
+static KError check_message(void const* data, u64 size, u16 align);
+static u64 message_bytes(u64 size);
+static void write_message(THMessageQueue*, u64 offset, THMessageKind, void const*, u64 size, u16 align);
+static void publish(THMessageQueue*, u64 bytes, u32 count);
+static KError wait_for_pending(THMessageQueue*);
+
 C_API KError th_message_queue_init(THMessageQueue* q, u64 min_capacity)
 {
     if (!C_ASSERT(q != nullptr)) return kerror_unix(EINVAL);
@@ -25,7 +32,7 @@ C_API KError th_message_queue_init(THMessageQueue* q, u64 min_capacity)
     MEMZERO(q);
     KError error = ring_buffer_init(&q->buffer, min_capacity);
     if (!error.ok) return error;
-    th_sem_init(&q->messages, 0);
+    th_sem_init(&q->wakeup, 0);
 
     ty_set_initialized(q);
     return kerror_none;
@@ -40,7 +47,7 @@ C_API KError th_message_queue_lazy_init(THMessageQueue* q, u64 min_capacity)
     MEMZERO(q);
     KError error = ring_buffer_lazy_init(&q->buffer, min_capacity);
     if (!error.ok) return error;
-    th_sem_init(&q->messages, 0);
+    th_sem_init(&q->wakeup, 0);
 
     ty_set_initialized(q);
     return kerror_none;
@@ -50,36 +57,48 @@ C_API void th_message_queue_deinit(THMessageQueue* q)
 {
     if (ty_is_initialized(q)) {
         ring_buffer_deinit(&q->buffer);
-        th_sem_deinit(&q->messages);
+        th_sem_deinit(&q->wakeup);
         q->version = 0;
     }
 }
 
 C_API KError th_message_send(THMessageQueue* q, THMessageKind kind, void const* data, u64 size, u16 align)
 {
-    if (!C_ASSERT(q != nullptr)) return kerror_unix(EINVAL);
-    if (!C_ASSERT(ty_is_initialized(q))) return kerror_unix(EINVAL);
-    if (!C_ASSERT(data != nullptr)) return kerror_unix(EINVAL);
-    if (!C_ASSERT(size != 0)) return kerror_unix(EINVAL);
-    if (!C_ASSERT(align != 0)) return kerror_unix(EINVAL);
-    if (!C_ASSERT(u64_popcount(align) == 1)) return kerror_unix(EINVAL);
+    TRY(check_writer(q));
+    TRY(check_message(data, size, align));
 
-    if (!kthread_id_is_valid(q->writer)) q->writer = current_thread_id();
-    if (!C_ASSERT(kthread_id_equal(q->writer, current_thread_id()))) return kerror_unix(EINVAL);
+    u64 bytes = message_bytes(size);
+    if (!ring_buffer_has_room(&q->buffer, (u32)bytes))
+        return kerror_unix(EAGAIN);
 
-    TRY(ring_buffer_ensure_initialized(&q->buffer));
+    write_message(q, 0, kind, data, size, align);
+    publish(q, bytes, 1);
+
+    return kerror_none;
+}
+
+C_API KError th_message_send_many(THMessageQueue* q, THMessage const* messages, u32 count)
+{
+    TRY(check_writer(q));
+    if (!C_ASSERT(messages != nullptr || count == 0)) return kerror_unix(EINVAL);
 
-    u64 bytes = size + sizeof(THMessage);
-    if (ring_buffer_size_left(&q->buffer) < bytes)
+    u64 bytes = 0;
+    for (u32 i = 0; i < count; i++) {
+        TRY(check_message(messages[i].data, messages[i].size, messages[i].align));
+        bytes += message_bytes(messages[i].size);
+    }
+    if (bytes == 0) return kerror_none;
+    if (bytes >= q->buffer.capacity) return kerror_unix(EMSGSIZE);
+    if (!ring_buffer_has_room(&q->buffer, (u32)bytes))
         return kerror_unix(EAGAIN);
 
-    Header* message = (Header*)ring_buffer_write_ptr(&q->buffer);
-    message->kind = kind;
-    message->size = size;
-    message->align = align;
-    memcpy(message->data, data, size);
-    ring_buffer_produce(&q->buffer, bytes);
-    th_sem_signal(&q->messages);
+    u64 offset = 0;
+    for (u32 i = 0; i < count; i++) {
+        THMessage const* message = &messages[i];
+        write_message(q, offset, message->kind, message->data, message->size, message->align);
+        offset += message_bytes(message->size);
+    }
+    publish(q, bytes, count);
 
     return kerror_none;
 }
@@ -101,8 +120,8 @@ C_API [[nodiscard]] bool th_message_try_read(THMessageQueue* q, THMessage* out)
 
     MEMZERO(out);
 
+    if (q->pending == 0) return false;
     u64 buffer_size = ring_buffer_size(&q->buffer);
-    if (buffer_size == 0) return false;
     if (!C_ASSERT(buffer_size > sizeof(THMessage))) return false;
 
     Header* ptr = (Header*)ring_buffer_read_ptr(&q->buffer);
@@ -111,8 +130,8 @@ C_API [[nodiscard]] bool th_message_try_read(THMessageQueue* q, THMessage* out)
     THMessageKind kind = ptr->kind;
     void* data = tclone(ptr->data, size, align);
     if (!C_ASSERT(data != nullptr)) return false;
-    ring_buffer_consume(&q->buffer, sizeof(THMessage) + size);
-    VERIFY(th_sem_wait_for(&q->messages, 0).ok);
+    ring_buffer_consume(&q->buffer, (u32)message_bytes(size));
+    q->pending -= 1;
 
     *out = (THMessage){
         .size = size,
@@ -134,25 +153,19 @@ C_API KError th_message_wait(THMessageQueue* q, THMessage* out)
 
     MEMZERO(out);
 
-    KError error = th_sem_wait(&q->messages);
-    if (!error.ok) return error;
+    TRY(wait_for_pending(q));
 
     u64 buffer_size = ring_buffer_size(&q->buffer);
-    if (!C_ASSERT(buffer_size > sizeof(THMessage))) {
-        th_sem_signal(&q->messages);
-        return kerror_unix(EINVAL);
-    }
+    if (!C_ASSERT(buffer_size > sizeof(THMessage))) return kerror_unix(EINVAL);
 
     Header* ptr = (Header*)ring_buffer_read_ptr(&q->buffer);
     u64 size = ptr->size;
     u16 align = ptr->align;
     THMessageKind kind = ptr->kind;
     void* data = tclone(ptr->data, size, align);
-    if (!C_ASSERT(data != nullptr)) {
-        th_sem_signal(&q->messages);
-        return kerror_unix(ENOMEM);
-    }
-    ring_buffer_consume(&q->buffer, sizeof(THMessage) + size);
+    if (!C_ASSERT(data != nullptr)) return kerror_unix(ENOMEM);
+    ring_buffer_consume(&q->buffer, (u32)message_bytes(size));
+    q->pending -= 1;
 
     *out = (THMessage){
         .size = size,
@@ -162,3 +175,67 @@ C_API KError th_message_wait(THMessageQueue* q, THMessage* out)
     };
     return kerror_none;
 }
+
+static KError check_writer(THMessageQueue* q)
+{
+    if (!C_ASSERT(q != nullptr)) return kerror_unix(EINVAL);
+    if (!C_ASSERT(ty_is_initialized(q))) return kerror_unix(EINVAL);
+
+    if (!kthread_id_is_valid(q->writer)) q->writer = current_thread_id();
+    if (!C_ASSERT(kthread_id_equal(q->writer, current_thread_id()))) return kerror_unix(EINVAL);
+
+    return ring_buffer_ensure_initialized(&q->buffer);
+}
+
+static KError check_message(void const* data, u64 size, u16 align)
+{
+    if (!C_ASSERT(data != nullptr)) return kerror_unix(EINVAL);
+    if (!C_ASSERT(size != 0)) return kerror_unix(EINVAL);
+    if (!C_ASSERT(align != 0)) return kerror_unix(EINVAL);
+    if (!C_ASSERT(u64_popcount(align) == 1)) return kerror_unix(EINVAL);
+    return kerror_none;
+}
+
+static u64 message_bytes(u64 size)
+{
+    return size + sizeof(THMessage);
+}
+
+static void write_message(THMessageQueue* q, u64 offset, THMessageKind kind, void const* data, u64 size, u16 align)
+{
+    Header* message = (Header*)(ring_buffer_write_ptr(&q->buffer) + offset);
+    message->kind = kind;
+    message->size = size;
+    message->align = align;
+    memcpy(message->data, data, size);
+}
+
+static void publish(THMessageQueue* q, u64 bytes, u32 count)
+{
+    ring_buffer_produce(&q->buffer, (u32)bytes);
+    q->pending += count;
+
+    // NOTE: pending is bumped before reader_sleeping is read and the reader
+    //       does the opposite, so one of the two always sees the other.
+    if (q->reader_sleeping) {
+        q->reader_sleeping = 0;
+        th_sem_signal(&q->wakeup);
+    }
+}
+
+static KError wait_for_pending(THMessageQueue* q)
+{
+    // NOTE: A wakeup may be left over from a round where the reader found
+    //       messages on its own, so waking up does not imply pending != 0.
+    while (q->pending == 0) {
+        q->reader_sleeping = 1;
+        if (q->pending != 0) {
+            q->reader_sleeping = 0;
+            break;
+        }
+        KError error = th_sem_wait(&q->wakeup);
+        q->reader_sleeping = 0;
+        if (!error.ok) return error;
+    }
+    return kerror_none;
+}
@@ -17,7 +17,12 @@ typedef struct THMessageQueue {
     u64 version;
 
     RingBuffer buffer;
-    THSemaphore messages;
+
+    // NOTE: Messages are counted in user space, the semaphore is only
+    //       signaled when the reader has said it is going to sleep.
+    _Atomic u32 pending;
+    _Atomic u32 reader_sleeping;
+    THSemaphore wakeup;
 
     KThreadID reader;
     KThreadID writer;
@@ -37,6 +42,10 @@ C_API void th_message_queue_deinit(THMessageQueue*);
 C_API KError th_message_send(THMessageQueue*, THMessageKind, void const*, u64 size, u16 align);
 #define TH_MESSAGE_SEND(q, kind, data) th_message_send(q, kind, data, sizeof(*data), alignof(__typeof(*data)))
 
+// NOTE: Publishes all messages at once or none of them (EAGAIN), waking the
+//       reader at most once for the whole batch.
+C_API KError th_message_send_many(THMessageQueue*, THMessage const* messages, u32 count);
+
 #ifdef __cplusplus
 template <typename T>
     requires (T::kind.tag != 0)
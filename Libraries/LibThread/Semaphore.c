@@ -3,24 +3,46 @@
 #include <Basic/Error.h>
 #include <Basic/Verify.h>
 #include <Basic/Context.h>
-#include <mach/clock_types.h>
-#include <mach/semaphore.h>
 
-#if TARGET_OS_OSX
 #include <errno.h>
+
+#if TARGET_OS_OSX
+#include <mach/clock_types.h>
+#include <mach/semaphore.h>
 #include <mach/kern_return.h>
 #include <mach/mach_error.h>
 #include <mach/sync_policy.h>
 #include <mach/task.h>
 #include <mach/mach_init.h>
+#elif defined(__linux__)
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
 #endif
 
+// NOTE: A handoff to a thread that is already running takes well under a
+//       microsecond, parking and waking takes several.
+static constexpr u32 spin_min = 16;
+static constexpr u32 spin_max = 4096;
+static constexpr u32 spin_initial = 128;
+
+static bool try_take(THSemaphore*);
+static bool spin_take(THSemaphore*);
+static void cpu_relax(void);
+
 #if TARGET_OS_OSX
 
+static KError park(THSemaphore*, i32 milliseconds);
+
 C_API void th_sem_init(THSemaphore* sem, i32 initial_value)
 {
+    VERIFY(initial_value >= 0);
+    sem->count = initial_value;
+    sem->waiters = 0;
+    sem->spin_budget = spin_initial;
     sem->owner = mach_task_self();
-    kern_return_t rv = semaphore_create(sem->owner, &sem->event, SYNC_POLICY_FIFO, initial_value);
+    kern_return_t rv = semaphore_create(sem->owner, &sem->event, SYNC_POLICY_FIFO, 0);
     VERIFY(rv == KERN_SUCCESS);
 }
 
@@ -34,7 +56,8 @@ C_API void th_sem_signal(THSemaphore* sem)
 {
     if (!C_ASSERT(sem != nullptr)) return;
     if (!C_ASSERT(sem->event != 0)) return;
-    semaphore_signal(sem->event);
+    if ((sem->count += 1) - 1 < 0)
+        semaphore_signal(sem->event);
 }
 
 C_API KError th_sem_wait_for(THSemaphore* sem, i32 milliseconds)
@@ -42,46 +65,171 @@ C_API KError th_sem_wait_for(THSemaphore* sem, i32 milliseconds)
     if (!C_ASSERT(sem != nullptr)) return kerror_unix(EINVAL);
     if (!C_ASSERT(sem->event != 0)) return kerror_unix(EINVAL);
     if (!C_ASSERT(milliseconds >= 0)) return kerror_unix(EINVAL);
-
-    i32 seconds = milliseconds / 1000;
-    milliseconds -= seconds * 1000;
-    mach_timespec_t timeout = {
-        .tv_sec = seconds,
-        .tv_nsec = milliseconds * 1'000'000,
-    };
-    kern_return_t rv = semaphore_timedwait(sem->event, timeout);
-    switch (rv) {
-    case KERN_SUCCESS: return kerror_none;
-    case KERN_OPERATION_TIMED_OUT: return kerror_unix(EAGAIN);
-    case KERN_INVALID_ARGUMENT: return kerror_unix(EINVAL);
-    case KERN_TERMINATED: return kerror_unix(EINVAL);
-    default:
-        errorf("could not wait for semaphore: %s", mach_error_string(rv));
-        return kerror_unix(EINVAL);
-    }
+    return park(sem, milliseconds);
 }
 
 C_API KError th_sem_wait(THSemaphore* sem)
 {
     if (!C_ASSERT(sem != nullptr)) return kerror_unix(EINVAL);
     if (!C_ASSERT(sem->event != 0)) return kerror_unix(EINVAL);
+    return park(sem, -1);
+}
+
+static KError park(THSemaphore* sem, i32 milliseconds)
+{
+    if (try_take(sem) || spin_take(sem))
+        return kerror_none;
+    if ((sem->count -= 1) + 1 > 0)
+        return kerror_none;
+
     kern_return_t rv = KERN_ABORTED;
+    if (milliseconds < 0) {
+        while (rv == KERN_ABORTED) rv = semaphore_wait(sem->event);
+    } else {
+        i32 seconds = milliseconds / 1000;
+        mach_timespec_t timeout = {
+            .tv_sec = seconds,
+            .tv_nsec = (milliseconds - seconds * 1000) * 1'000'000,
+        };
+        rv = semaphore_timedwait(sem->event, timeout);
+    }
+    if (rv == KERN_SUCCESS)
+        return kerror_none;
+
+    // NOTE: Give back the slot taken above. If a signal already counted it,
+    //       its wake up is on the way and the token is ours after all.
+    i32 count = sem->count;
+    while (count < 0) {
+        if (__c11_atomic_compare_exchange_weak(&sem->count, &count, count + 1, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST)) {
+            if (rv == KERN_OPERATION_TIMED_OUT || rv == KERN_ABORTED) return kerror_unix(EAGAIN);
+            errorf("could not wait for semaphore: %s", mach_error_string(rv));
+            return kerror_unix(EINVAL);
+        }
+    }
+    rv = KERN_ABORTED;
     while (rv == KERN_ABORTED) rv = semaphore_wait(sem->event);
-    switch (rv) {
-    case KERN_SUCCESS: return kerror_none;
-    case KERN_OPERATION_TIMED_OUT: return kerror_unix(EAGAIN);
-    case KERN_INVALID_ARGUMENT:
-        errorf("could not wait for semaphore: %s", mach_error_string(rv));
-        return kerror_unix(EINVAL);
-    case KERN_TERMINATED:
-        errorf("could not wait for semaphore: %s", mach_error_string(rv));
-        return kerror_unix(EINVAL);
-    default:
-        errorf("could not wait for semaphore: %s", mach_error_string(rv));
-        return kerror_unix(EINVAL);
+    return kerror_none;
+}
+
+#elif defined(__linux__)
+
+static KError park(THSemaphore*, struct timespec const* deadline);
+static long futex_wait(_Atomic i32*, struct timespec const* deadline);
+static void futex_wake(_Atomic i32*, i32 count);
+
+C_API void th_sem_init(THSemaphore* sem, i32 initial_value)
+{
+    VERIFY(initial_value >= 0);
+    sem->count = initial_value;
+    sem->waiters = 0;
+    sem->spin_budget = spin_initial;
+}
+
+C_API void th_sem_deinit(THSemaphore* sem)
+{
+    VERIFY(sem->waiters == 0);
+}
+
+C_API void th_sem_signal(THSemaphore* sem)
+{
+    if (!C_ASSERT(sem != nullptr)) return;
+    sem->count += 1;
+    if (sem->waiters != 0)
+        futex_wake(&sem->count, 1);
+}
+
+C_API KError th_sem_wait_for(THSemaphore* sem, i32 milliseconds)
+{
+    if (!C_ASSERT(sem != nullptr)) return kerror_unix(EINVAL);
+    if (!C_ASSERT(milliseconds >= 0)) return kerror_unix(EINVAL);
+
+    struct timespec deadline;
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    deadline.tv_sec += milliseconds / 1000;
+    deadline.tv_nsec += (long)(milliseconds % 1000) * 1'000'000;
+    if (deadline.tv_nsec >= 1'000'000'000) {
+        deadline.tv_sec += 1;
+        deadline.tv_nsec -= 1'000'000'000;
     }
+    return park(sem, &deadline);
+}
+
+C_API KError th_sem_wait(THSemaphore* sem)
+{
+    if (!C_ASSERT(sem != nullptr)) return kerror_unix(EINVAL);
+    return park(sem, nullptr);
+}
+
+static KError park(THSemaphore* sem, struct timespec const* deadline)
+{
+    if (try_take(sem) || spin_take(sem))
+        return kerror_none;
+
+    // NOTE: Announce before the last look, a signal that lands after the
+    //       look sees waiters and wakes, one before it leaves a token.
+    sem->waiters += 1;
+    for (;;) {
+        if (try_take(sem)) {
+            sem->waiters -= 1;
+            return kerror_none;
+        }
+        long rv = futex_wait(&sem->count, deadline);
+        if (rv < 0 && errno == ETIMEDOUT) {
+            bool taken = try_take(sem);
+            sem->waiters -= 1;
+            return taken ? kerror_none : kerror_unix(EAGAIN);
+        }
+    }
+}
+
+static long futex_wait(_Atomic i32* word, struct timespec const* deadline)
+{
+    // NOTE: BITSET takes an absolute CLOCK_MONOTONIC deadline, so spurious
+    //       wake ups do not stretch the timeout.
+    return syscall(SYS_futex, (u32*)word, FUTEX_WAIT_BITSET_PRIVATE, 0, deadline, nullptr, FUTEX_BITSET_MATCH_ANY);
+}
+
+static void futex_wake(_Atomic i32* word, i32 count)
+{
+    syscall(SYS_futex, (u32*)word, FUTEX_WAKE_PRIVATE, count, nullptr, nullptr, 0);
 }
 
 #else
 #error "unsupported OS"
 #endif
+
+static bool try_take(THSemaphore* sem)
+{
+    i32 count = __c11_atomic_load(&sem->count, __ATOMIC_RELAXED);
+    while (count > 0) {
+        if (__c11_atomic_compare_exchange_weak(&sem->count, &count, count - 1, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED))
+            return true;
+    }
+    return false;
+}
+
+static bool spin_take(THSemaphore* sem)
+{
+    // NOTE: Racy on purpose, the budget is only a hint shared by waiters.
+    u32 budget = __c11_atomic_load(&sem->spin_budget, __ATOMIC_RELAXED);
+    for (u32 i = 0; i < budget; i++) {
+        cpu_relax();
+        if (try_take(sem)) {
+            u32 grown = budget * 2 < spin_max ? budget * 2 : spin_max;
+            __c11_atomic_store(&sem->spin_budget, grown, __ATOMIC_RELAXED);
+            return true;
+        }
+    }
+    u32 shrunk = budget / 2 > spin_min ? budget / 2 : spin_min;
+    __c11_atomic_store(&sem->spin_budget, shrunk, __ATOMIC_RELAXED);
+    return false;
+}
+
+static void cpu_relax(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    __builtin_arm_yield();
+#endif
+}
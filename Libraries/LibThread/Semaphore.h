@@ -7,18 +7,28 @@
 #if TARGET_OS_OSX
 #include <mach/task.h>
 #include <mach/semaphore.h>
-#else
+#elif !defined(__linux__)
 #error "unsupported OS"
 #endif
 
 typedef struct THSemaphore THSemaphore;
 
-#if TARGET_OS_OSX
+// NOTE: Tokens are counted in user space, so a signal with nobody asleep
+//       and a wait with a token available never enter the kernel. Waiters
+//       spin for a while before they park, the spin length adapts to how
+//       often spinning has paid off. On macOS a count below zero is the
+//       number of parked waiters, on Linux they are counted in waiters and
+//       park on count with a futex.
 typedef struct THSemaphore {
+    _Atomic i32 count;
+    _Atomic u32 waiters;
+    _Atomic u32 spin_budget;
+
+#if TARGET_OS_OSX
     task_t owner;
     semaphore_t event;
-} THSemaphore;
 #endif
+} THSemaphore;
 
 C_API void th_sem_init(THSemaphore*, i32 initial_value);
 C_API void th_sem_deinit(THSemaphore*);
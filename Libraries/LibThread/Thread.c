@@ -1,25 +1,67 @@
+#ifdef __linux__
+#define _GNU_SOURCE // pthread_setaffinity_np, pthread_getattr_np
+#endif
 #include "./Thread.h"
 
 #include <Basic/Verify.h>
 #include <Basic/FileLogger.h>
 #include <Basic/FixedArena.h>
 #include <Basic/Context.h>
+#include <Basic/PageAllocator.h>
+#include <Basic/Bits.h>
 
 #if PLATFORM_POSIX
 
+#include <errno.h>
+#include <limits.h>
+#include <sched.h>
+
+#ifdef __linux__
+#include <sys/resource.h>
+#endif
+
+#if TARGET_OS_OSX
+#include <mach/mach_init.h>
+#include <mach/thread_act.h>
+#include <mach/thread_policy.h>
+#endif
+
 static void* entry_proc(void*);
 
+static KError apply_policy(THThreadPolicy, i32 priority);
+static KError apply_affinity(u64 affinity, i32 preferred_core);
+static void prefault_stack(void);
+
 C_API KError th_thread_init(THThread* thread, c_string name, Context starting_context, void* data, void(*proc)(void*))
+{
+    return th_thread_init_with_options(thread, name, starting_context, (THThreadOptions){}, data, proc);
+}
+
+C_API KError th_thread_init_with_options(THThread* thread, c_string name, Context starting_context, THThreadOptions options, void* data, void(*proc)(void*))
 {
     MEMZERO(thread);
     thread->name = name;
     thread->id = kthread_id_next();
     thread->starting_context = starting_context;
+    thread->options = options;
     thread->user = data;
     thread->proc = proc;
     th_sem_init(&thread->suspended, 0);
 
-    int err = pthread_create(&thread->thread_handle, nullptr, entry_proc, thread);
+    pthread_attr_t attr;
+    int err = pthread_attr_init(&attr);
+    if (err != 0) {
+        th_sem_deinit(&thread->suspended);
+        return kerror_unix(err);
+    }
+    if (options.stack_size != 0) {
+        u64 stack_size = __builtin_align_up(options.stack_size, (u64)page_size());
+        if (stack_size < PTHREAD_STACK_MIN) stack_size = PTHREAD_STACK_MIN;
+        err = pthread_attr_setstacksize(&attr, stack_size);
+    }
+    if (err == 0)
+        err = pthread_create(&thread->thread_handle, &attr, entry_proc, thread);
+    pthread_attr_destroy(&attr);
     if (err != 0) {
         th_sem_deinit(&thread->suspended);
         return kerror_unix(err);
@@ -28,6 +70,16 @@ C_API KError th_thread_init(THThread* thread, c_string name, Context starting_co
     return kerror_none;
 }
 
+C_API KError th_thread_apply_options(THThreadOptions options)
+{
+    KError policy_error = apply_policy(options.policy, options.priority);
+    KError affinity_error = apply_affinity(options.affinity, options.preferred_core);
+    if (options.prefault_stack)
+        prefault_stack();
+    if (!policy_error.ok) return policy_error;
+    return affinity_error;
+}
+
 C_API void th_thread_start(THThread* thread) { th_sem_signal(&thread->suspended); }
 
 static void* entry_proc(void* user)
@@ -53,11 +105,104 @@ static void* entry_proc(void* user)
 #endif
 
     init_context(context);
+    KError options_error = th_thread_apply_options(thread->options);
+    if (!options_error.ok)
+        warnf("could not apply all thread options: %s", kerror_tstring(options_error));
     thread->proc(thread->user);
 
     return nullptr;
 }
 
+static KError apply_policy(THThreadPolicy policy, i32 priority)
+{
+    if (policy == THThreadPolicy_Default) return kerror_none;
+
+    int sched_policy = policy == THThreadPolicy_FIFO ? SCHED_FIFO : SCHED_RR;
+    int min = sched_get_priority_min(sched_policy);
+    int max = sched_get_priority_max(sched_policy);
+    if (priority < min) priority = min;
+    if (priority > max) priority = max;
+
+    struct sched_param param = { .sched_priority = priority };
+    int err = pthread_setschedparam(pthread_self(), sched_policy, &param);
+    if (err != EPERM) return err == 0 ? kerror_none : kerror_unix(err);
+
+#ifdef __linux__
+    // NOTE: Unprivileged users can still get real time up to RLIMIT_RTPRIO,
+    //       which is how most audio setups grant it.
+    struct rlimit limit;
+    if (getrlimit(RLIMIT_RTPRIO, &limit) == 0 && limit.rlim_cur > 0 && (i32)limit.rlim_cur < priority) {
+        param.sched_priority = (int)limit.rlim_cur;
+        if (param.sched_priority >= min && pthread_setschedparam(pthread_self(), sched_policy, &param) == 0)
+            return kerror_none;
+    }
+#endif
+    return kerror_unix(EPERM);
+}
+
+static KError apply_affinity(u64 affinity, i32 preferred_core)
+{
+    if (affinity == 0 && preferred_core == 0) return kerror_none;
+#ifdef __linux__
+    // NOTE: Linux has no soft preference, a preferred core without a mask
+    //       pins to it, inside a mask it is only honored if the mask has it.
+    u64 mask = affinity;
+    if (preferred_core > 0 && preferred_core <= 64) {
+        u64 preferred = 1ULL << (preferred_core - 1);
+        if (mask == 0 || (mask & preferred)) mask = preferred;
+    }
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (u32 cpu = 0; cpu < 64; cpu++) {
+        if (mask & (1ULL << cpu)) CPU_SET(cpu, &set);
+    }
+    int err = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    return err == 0 ? kerror_none : kerror_unix(err);
+#elif TARGET_OS_OSX
+    // NOTE: macOS does not pin threads, an affinity tag only asks for
+    //       threads with the same tag to share an L2. The preferred core
+    //       becomes the tag, which is the closest it gets.
+    (void)affinity;
+    if (preferred_core == 0) return kerror_none;
+    thread_affinity_policy_data_t policy = { .affinity_tag = preferred_core };
+    // NOTE: pthread_mach_thread_np() borrows the thread's port, unlike
+    //       mach_thread_self() which hands out a send right to deallocate.
+    kern_return_t rv = thread_policy_set(pthread_mach_thread_np(pthread_self()), THREAD_AFFINITY_POLICY, (thread_policy_t)&policy, THREAD_AFFINITY_POLICY_COUNT);
+    return rv == KERN_SUCCESS ? kerror_none : kerror_unix(ENOTSUP);
+#else
+    (void)affinity;
+    (void)preferred_core;
+    return kerror_unix(ENOTSUP);
+#endif
+}
+
+static void prefault_stack(void)
+{
+    // NOTE: Touch every page between the guard page and a little below the
+    //       current frame, so the first deep call on a real time path does
+    //       not take a page fault per page.
+    u8* low = nullptr;
+    u8 marker = 0;
+    u8* here = (u8*)&marker;
+#ifdef __linux__
+    pthread_attr_t attr;
+    void* stack_addr = nullptr;
+    size_t stack_size = 0;
+    if (pthread_getattr_np(pthread_self(), &attr) != 0) return;
+    pthread_attr_getstack(&attr, &stack_addr, &stack_size);
+    pthread_attr_destroy(&attr);
+    low = (u8*)stack_addr;
+#elif TARGET_OS_OSX
+    low = (u8*)pthread_get_stackaddr_np(pthread_self()) - pthread_get_stacksize_np(pthread_self());
+#endif
+    if (!low) return;
+
+    u64 page = (u64)page_size();
+    u8* high = here - 4 * KiB;
+    for (u8* p = (u8*)__builtin_align_up(low + page, page); p < high; p += page)
+        *(u8 volatile*)p = 0;
+}
+
 #else
 #error "unsupported platform"
 #endif
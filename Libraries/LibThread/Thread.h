@@ -14,12 +14,29 @@
 #error "unsupported platform"
 #endif
 
+typedef enum THThreadPolicy : u8 {
+    THThreadPolicy_Default,
+    THThreadPolicy_FIFO,
+    THThreadPolicy_RoundRobin,
+} THThreadPolicy;
+
+// NOTE: Zero initialized options leave everything at the system default.
+typedef struct THThreadOptions {
+    THThreadPolicy policy;
+    i32 priority;        // Clamped to what the policy allows.
+    u64 affinity;        // One bit per CPU, zero leaves it alone.
+    i32 preferred_core;  // Plus one, zero for none.
+    u64 stack_size;      // Zero for the default.
+    bool prefault_stack;
+} THThreadOptions;
+
 typedef struct THThread THThread;
 typedef struct THThread {
     c_string name;
     KThreadID id;
     void* user;
     Context starting_context;
+    THThreadOptions options;
     void (*proc)(void*);
 
 #if PLATFORM_POSIX
@@ -31,4 +48,12 @@ typedef struct THThread {
 } THThread;
 
 C_API KError th_thread_init(THThread*, c_string name, Context starting_context, void* data, void(*)(void*));
+C_API KError th_thread_init_with_options(THThread*, c_string name, Context starting_context, THThreadOptions, void* data, void(*)(void*));
 C_API void th_thread_start(THThread*);
+
+// NOTE: Applies options to the calling thread, which is how threads made by
+//       someone else (the SoundIo callback) get the same profile. Whatever
+//       can be applied is, a real time policy that is not permitted falls
+//       back to the highest allowed priority or the default policy, and the
+//       first thing that failed is returned. stack_size is ignored here.
+C_API KError th_thread_apply_options(THThreadOptions);
@@ -1,5 +1,6 @@
 #include "./Audio.h"
 
+#include "./Voices.h"
 #include "../State.h"
 
 #include <Basic/Bits.h>
@@ -9,8 +10,10 @@
 
 #include <LibCore/Actor.h>
 #include <LibAudio/AudioDecoder.h>
+#include <LibDSP/Position.h>
 
 #include <math.h>
+#include <string.h>
 
 [[maybe_unused]]
 static f64 combine(f64 a, f64 b)
@@ -77,108 +80,90 @@ static f64 frames_per_pulse(PersistedSettings const* settings)
     return 1.0 / ppf;
 }
 
-[[maybe_unused]]
-static f64 sample_at_pulse(PersistedSettings const* settings, StableAudio* ctx, StringSlice path, u32 channel, f64 pulse)
-{
-    auto* audio_manager = &ctx->audio_manager;
-    i64 frame = (i64)(frames_per_pulse(settings) * pulse);
-    return audio_manager->sample(
-        audio_manager->audio(path),
-        frame, channel
-    );
-}
-
 [[maybe_unused]]
 static bool within(f64 a, f64 x, f64 b)
 {
     return x >= a && x <= b;
 }
 
-static f64 sample_at_pulse(PersistedState const* persisted, StableAudio* stable, TransAudio* trans, f64 pulse, f64)
-{
-    guard (pulse >= 0.0) else return 0;
-    guard (ty_is_initialized(persisted)) else return 0;
-    auto* settings = persisted->sections.settings;
-    guard (ty_is_initialized(settings)) else return 0;
-    guard (ty_is_initialized(stable)) else return 0;
-    ty_trans_migrate(trans);
-
-    f64 sample = 0;
+typedef struct PatternTrack {
+    StringSlice path;
+    f64 gain;
+    f64 rate;   // Source frames per output frame.
+    f64 period; // In seconds at the current tempo.
+    f64 shift;  // In seconds at the current tempo, the track hits when (pulse + shift) % period == 0.
+    f64 choke;  // Frames to fade out earlier hits over when the track hits again, 0 lets them ring.
+} PatternTrack;
 
 #if 1
-    bool kick_909 = false;
-    f64 kick_909_pulse = fmod(pulse + pulses_per_second(settings) / 1.0, pulses_per_second(settings) * 1.0 / 2.0);
-    if (within(0, kick_909_pulse, 1)) kick_909 = true;
-    sample += 1.0 * sample_at_pulse(settings, stable, "Samples/909/BT0A0D3.WAV"s, 0, kick_909_pulse);
-
-    bool kick_808 = false;
-    f64 kick_808_pulse = fmod(pulse + pulses_per_second(settings) / 1.0, pulses_per_second(settings) * 4.0 / 2.0);
-    if (within(0, kick_808_pulse, 1)) kick_808 = true;
-    sample += 1.0 * sample_at_pulse(settings, stable, "Samples/808/BD/BD0010.WAV"s, 0, kick_808_pulse);
-
-    bool snare = false;
-    f64 snare_pulse = fmod(pulse - pulses_per_second(settings) / 1.0, pulses_per_second(settings) * 1.0 / 1.0);
-    if (within(0, snare_pulse, 1)) snare = true;
-    sample += 1.2 * sample_at_pulse(settings, stable, "Samples/808/SD/SD0010.WAV"s, 0, snare_pulse);
-
-    bool hihat = false;
-    f64 hihat_pulse = fmod(pulse + pulses_per_second(settings) / 1.0, pulses_per_second(settings) * 1.0 / 8.0);
-    if (hihat_pulse < 1) hihat = true;
-    sample += 1.2 * sample_at_pulse(settings, stable, "Samples/808/CH/CH.WAV"s, 0, hihat_pulse);
-
-    bool symbal = false;
-    f64 symbal_pulse = fmod(pulse + pulses_per_second(settings) / 1.0, pulses_per_second(settings) * 2.0 / 1.0);
-    if (within(0, symbal_pulse, 1)) symbal = true;
-    sample += sample_at_pulse(settings, stable, "Samples/808/CY/CY5010.WAV"s, 0, symbal_pulse);
-
-    if (kick_909 | kick_808 | snare | hihat | symbal) {
-        debugf("%s | %s | %s | %s | %s",
-            kick_909  ? "kick 909"  : "        ",
-            kick_808  ? "kick 808"  : "        ",
-            snare ? "snare" : "     ",
-            hihat ? "hihat" : "     ",
-            symbal ? "symbal" : "     "
-        );
-    }
+static PatternTrack const pattern[] = {
+    { .path = "Samples/909/BT0A0D3.WAV"s,   .gain = 1.0, .rate = 1.0, .period = 1.0 / 2.0, .shift = 1.0 },
+    { .path = "Samples/808/BD/BD0010.WAV"s, .gain = 1.0, .rate = 1.0, .period = 4.0 / 2.0, .shift = 1.0 },
+    { .path = "Samples/808/SD/SD0010.WAV"s, .gain = 1.2, .rate = 1.0, .period = 1.0 / 1.0, .shift = -1.0 },
+    { .path = "Samples/808/CH/CH.WAV"s,     .gain = 1.2, .rate = 1.0, .period = 1.0 / 8.0, .shift = 1.0, .choke = 64.0 },
+    { .path = "Samples/808/CY/CY5010.WAV"s, .gain = 1.0, .rate = 1.0, .period = 2.0 / 1.0, .shift = 1.0 },
+};
 #else
-    bool kick = false;
-    f64 kick_909_pulse = fmod(pulse + pulses_per_second(settings) / 1.0, pulses_per_second(settings) * 1.0 / 1.2 * 1.0000) * 1;
-    if (within(0, kick_909_pulse, 1)) kick = true;
-    sample += 1.0 * sample_at_pulse(settings, stable, "Samples/909/BT0A0D3.WAV"s, 0, kick_909_pulse);
-
-    f64 kick_909_pulse2 = fmod(pulse + pulses_per_second(settings) / 1.0, pulses_per_second(settings) * 1.0 / 1.5 * 1.50000) * 1;
-    if (within(0, kick_909_pulse2, 1)) kick = true;
-    sample += 1.0 * sample_at_pulse(settings, stable, "Samples/909/BT0A0A7.WAV"s, 0, kick_909_pulse2);
-
-    bool snare = false;
-    f64 snare_pulse = fmod(pulse - pulses_per_second(settings) / 1.0, pulses_per_second(settings) * 1.0 / 2.0 * 1.00000) * 1;
-    if (within(0, snare_pulse, 1)) snare = true;
-    sample += 1.0 * sample_at_pulse(settings, stable, "Samples/808/SD/SD0010.WAV"s, 0, snare_pulse * 0.9);
-
-    bool hihat = false;
-    f64 hihat_pulse = fmod(pulse - pulses_per_second(settings) / 1.0, pulses_per_second(settings) * 1.0 / 2.0 * 1.00000) * 1;
-    if (within(0, hihat_pulse, 1)) hihat = true;
-    sample += 1.0 * sample_at_pulse(settings, stable, "Samples/808/CH/CH.WAV"s, 0, hihat_pulse);
-
-    if (kick || snare || hihat) {
-        debugf("%4s | %5s | %5s", kick ? "kick" : "", snare ? "snare" : "", hihat ? "hihat" : "");
-    }
+static PatternTrack const pattern[] = {
+    { .path = "Samples/909/BT0A0D3.WAV"s,   .gain = 1.0, .rate = 1.0, .period = 1.0 / 1.2, .shift = 1.0 },
+    { .path = "Samples/909/BT0A0A7.WAV"s,   .gain = 1.0, .rate = 1.0, .period = 1.0 / 1.5 * 1.5, .shift = 1.0 },
+    { .path = "Samples/808/SD/SD0010.WAV"s, .gain = 1.0, .rate = 0.9, .period = 1.0 / 2.0, .shift = -1.0 },
+    { .path = "Samples/808/CH/CH.WAV"s,     .gain = 1.0, .rate = 1.0, .period = 1.0 / 2.0, .shift = -1.0 },
+};
 #endif
 
-    return sample;
-
-    // f64 pulses_per_second = audio->pulses_per_quarter_note * audio->quarter_notes_per_second;
-    // f64 t = pulse / pulses_per_second;
-
-    // f64 target = sin(t * 2.0 * M_PI * 440.6) * 0.2;
-    // f64 target = sin(t * 2.0 * M_PI * 574.6) * 0.2;
-    // f64 target = sin(t * 2.0 * M_PI * 479) * 0.2;
+// NOTE: Hits are found analytically for the whole block and handed to the
+//       voice pool with their sub-frame offset, nothing is evaluated per
+//       sample here.
+static void schedule_pattern(PersistedSettings const* settings, StableAudio* stable, DSPPosition block_start, DSPPosition block_end)
+{
+    f64 pps = pulses_per_second(settings);
+    f64 frames_per_tick = frames_per_pulse(settings);
+    auto* audio_manager = &stable->audio_manager;
+
+    u32 hits = 0;
+    for (u32 track_index = 0; track_index < ARRAY_SIZE(pattern); track_index += 1) {
+        auto const* track = &pattern[track_index];
+        f64 period = track->period * pps;
+        f64 shift = track->shift * pps;
+        guard (period > 0.0) else continue;
+
+        f64 pulse = ceil((block_start.ticks + shift) / period) * period - shift;
+        if (pulse < 0.0) pulse += ceil(-pulse / period) * period;
+        if (pulse >= block_end.ticks) continue;
+
+        auto id = audio_manager->audio(track->path);
+
+        // NOTE: Choking happens at block start, so the previous hit can stop
+        //       up to a block before the new one begins.
+        if (track->choke > 0.0)
+            audio_voices_release(&stable->voices, id, track->choke);
+
+        for (; pulse < block_end.ticks; pulse += period) {
+            bool ok = audio_voices_trigger(&stable->voices, (AudioVoiceSpec){
+                .sample = id,
+                .gain = track->gain,
+                .increment = track->rate,
+                .start_offset = (pulse - block_start.ticks) * frames_per_tick,
+                .attack_frames = 0,
+            });
+            if (ok) hits |= 1u << track_index;
+        }
+    }
 
-    // return target;
+    if (hits) {
+        debugf("%s | %s | %s | %s | %s",
+            (hits & (1u << 0)) ? "kick 909" : "        ",
+            (hits & (1u << 1)) ? "kick 808" : "        ",
+            (hits & (1u << 2)) ? "snare" : "     ",
+            (hits & (1u << 3)) ? "hihat" : "     ",
+            (hits & (1u << 4)) ? "symbal" : "     "
+        );
+    }
 }
 
-C_API void audio_actor_frame(PersistedState const* persisted, StableAudio* stable, TransAudio* trans, f64* const* channels, u32 frame_count, u32 channel_count);
-C_API void audio_actor_frame(PersistedState const* persisted, StableAudio* stable, TransAudio* trans, f64* const* channels, u32 frame_count, u32 channel_count)
+C_API void audio_actor_frame(PersistedState const* persisted, StableAudio* stable, TransAudio* trans, AudioBuses buses);
+C_API void audio_actor_frame(PersistedState const* persisted, StableAudio* stable, TransAudio* trans, AudioBuses buses)
 {
     guard (persisted->version >= sizeof(*persisted)) else {
         return;
@@ -186,36 +171,36 @@ C_API void audio_actor_frame(PersistedState const* persisted, StableAudio* stabl
     guard (stable->version >= sizeof(*stable)) else {
         return;
     }
+    guard (ty_is_initialized(&stable->voices)) else {
+        return;
+    }
+    guard (buses.channel_count > 0) else {
+        return;
+    }
     ty_trans_migrate(trans);
     auto* settings = persisted->sections.settings;
     auto* playback = persisted->sections.playback;
 
-    f64 pulses_per_second = settings->pulses_per_quarter_note * settings->quarter_notes_per_second;
-    f64 pulses_per_frame = pulses_per_second / settings->frames_per_second;
-
-    f64 current_pulse_offset = playback->current_pulse_offset;
-    f64 current_pulse = playback->current_pulse;
-
-    for (u32 frame = 0; frame < frame_count; frame += 1) {
-        f64 sample = 0.0;
-        if (pulses_per_frame > 1.0) {
-            for (i64 pulse = 0; pulse < (i64)pulses_per_frame; pulse += 1) {
-                f64 offset = (f64)pulse;
-                sample += sample_at_pulse(persisted, stable, trans, current_pulse + offset, fmod(current_pulse_offset + offset, 1));
-            }
-            sample /= pulses_per_frame;
-        } else {
-            sample = sample_at_pulse(persisted, stable, trans, current_pulse, current_pulse_offset);
-        }
-        current_pulse += pulses_per_frame;
-        current_pulse_offset = fmod(current_pulse_offset + pulses_per_frame, 1);
+    f64 ticks_per_frame = pulses_per_frame(settings);
+    f64 frames_per_tick = frames_per_pulse(settings);
 
-        for (u32 channel = 0; channel < channel_count; channel += 1)
-            channels[channel][frame] = sample;
-    }
+    // NOTE: Map the whole block to a tick range once, the cost of a block is
+    //       then bound by the voice budget instead of the tempo grid.
+    u32 frame_count = buses.frame_count;
+    DSPPosition block_start = dsp_position_from_ticks(playback->current_pulse, frames_per_tick);
+    DSPPosition block_end = dsp_position_add_ticks(block_start, ticks_per_frame * (f64)frame_count, frames_per_tick);
+
+    schedule_pattern(settings, stable, block_start, block_end);
+
+    AUSample* mono = buses.channels[0];
+    audio_voices_render(&stable->voices, &stable->audio_manager, mono, frame_count);
+
+    // NOTE: The pattern is mono for now, so the other buses get a copy of the first.
+    for (u32 channel = 1; channel < buses.channel_count; channel += 1)
+        memcpy(buses.channels[channel], mono, frame_count * sizeof(*mono));
 
-    playback->current_pulse = playback->current_pulse + pulses_per_frame * frame_count;
-    playback->current_pulse_offset = fmod(playback->current_pulse_offset + pulses_per_frame * frame_count, 1);
+    playback->current_pulse = block_end.ticks;
+    playback->current_pulse_offset = fmod(playback->current_pulse_offset + ticks_per_frame * (f64)frame_count, 1);
 }
 
 C_API [[nodiscard]] bool audio_actor_init(Actor* actor, FSVolume* volume, bool use_auto_reload)
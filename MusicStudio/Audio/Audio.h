@@ -1,12 +1,22 @@
 #pragma once
 #include <Basic/Types.h>
 #include <LibCore/Forward.h>
+#include <LibAudio/AudioManager.h>
 
 typedef struct StableAudio StableAudio;
 typedef struct PersistedState PersistedState;
 typedef union TransAudio TransAudio;
+
+// NOTE: Planar output, one bus per device channel. Buses are cleared by the
+//       host before each frame, so actors may accumulate into them.
+typedef struct AudioBuses {
+    AUSample* const* channels;
+    u32 channel_count;
+    u32 frame_count;
+} AudioBuses;
+
 typedef struct AudioActor {
-    void(*_Atomic const audio_frame)(PersistedState const*, StableAudio*, TransAudio*, f64* const*, u32 frame_count, u32 channel_count);
+    void(*_Atomic const audio_frame)(PersistedState const*, StableAudio*, TransAudio*, AudioBuses);
 } AudioActor;
 
 C_API [[nodiscard]] bool audio_actor_init(Actor* actor, FSVolume*, bool use_auto_reload);
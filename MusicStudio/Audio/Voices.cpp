@@ -0,0 +1,262 @@
+#include "./Voices.h"
+
+#include <Basic/Allocator.h>
+#include <Basic/Defer.h>
+#include <Basic/Verify.h>
+
+#include <LibAudio/AudioManager.h>
+
+#include <string.h>
+
+// NOTE: A voice whose sample never finished loading is retired after this
+//       many source frames, so a missing file can not pin a voice forever.
+static constexpr i64 pending_sample_frames_max = 16 * au_audio_frames_per_block;
+
+static u32 clamp_budget(u32 budget);
+static u32 pick_victim(AudioVoices const*, AudioVoiceSteal);
+static bool voice_is_done(AudioVoices const*, AUAudioManager*, u32 index);
+static void remove_voice(AudioVoices*, u32 index);
+static void clear_voice(AudioVoices*, u32 index);
+
+C_API void audio_voices_init(AudioVoices* voices, u32 budget, AudioVoiceSteal steal)
+{
+    VERIFY(!ty_is_initialized(voices));
+    memzero(voices);
+    defer [=] { ty_set_initialized(voices); };
+
+    voices->budget = clamp_budget(budget);
+    voices->steal = steal;
+}
+
+C_API void audio_voices_configure(AudioVoices* voices, u32 budget, AudioVoiceSteal steal)
+{
+    VERIFY(ty_is_initialized(voices));
+    voices->budget = clamp_budget(budget);
+    voices->steal = steal;
+
+    while (voices->count > voices->budget) {
+        AudioVoiceSteal policy = steal == AudioVoiceSteal_Never ? AudioVoiceSteal_Oldest : steal;
+        remove_voice(voices, pick_victim(voices, policy));
+    }
+}
+
+C_API [[nodiscard]] bool audio_voices_trigger(AudioVoices* voices, AudioVoiceSpec spec)
+{
+    if (!C_ASSERT(ty_is_initialized(voices))) return false;
+    if (!C_ASSERT(spec.increment > 0.0)) return false;
+    if (!au_audio_id_is_valid(spec.sample)) return false;
+
+    u32 index = voices->count;
+    if (voices->count >= voices->budget) {
+        if (voices->steal == AudioVoiceSteal_Never)
+            return false;
+        // NOTE: Stolen voices are cut, fading them out would put us over budget.
+        index = pick_victim(voices, voices->steal);
+    } else {
+        voices->count += 1;
+    }
+
+    // NOTE: Starting at a negative source position delays the voice by
+    //       start_offset output frames, the fractional part ends up in phase
+    //       so the onset keeps its sub-frame position.
+    f64 start_offset = spec.start_offset > 0.0 ? spec.start_offset : 0.0;
+    f64 start = -start_offset * spec.increment;
+    f64 whole = __builtin_floor(start);
+
+    voices->phase[index] = start - whole;
+    voices->position[index] = (i64)whole;
+    voices->increment[index] = spec.increment;
+    voices->gain[index] = (AUSample)spec.gain;
+    voices->sample[index] = spec.sample;
+    voices->started[index] = voices->serial++;
+    if (spec.attack_frames > 0.0) {
+        voices->stage[index] = AudioEnvelopeStage_Attack;
+        voices->envelope[index] = 0.0;
+        voices->envelope_step[index] = (AUSample)(1.0 / spec.attack_frames);
+    } else {
+        voices->stage[index] = AudioEnvelopeStage_Sustain;
+        voices->envelope[index] = 1.0;
+        voices->envelope_step[index] = 0.0;
+    }
+    return true;
+}
+
+C_API void audio_voices_release(AudioVoices* voices, AUAudioID sample, f64 release_frames)
+{
+    if (!C_ASSERT(ty_is_initialized(voices))) return;
+    if (release_frames < 1.0) release_frames = 1.0;
+
+    for (u32 i = 0; i < voices->count; i++) {
+        if (voices->sample[i].hash != sample.hash) continue;
+        if (voices->stage[i] == AudioEnvelopeStage_Release) continue;
+        voices->stage[i] = AudioEnvelopeStage_Release;
+        voices->envelope_step[i] = (AUSample)(-voices->envelope[i] / release_frames);
+    }
+}
+
+C_API void audio_voices_render(AudioVoices* voices, AUAudioManager* audio, AUSample* out, u32 frame_count)
+{
+    if (!C_ASSERT(ty_is_initialized(voices))) return;
+
+    AudioVoiceLane const lane_zero = {};
+    AudioVoiceLane const lane_one = lane_zero + (AUSample)1;
+
+    for (u32 lane = 0; lane < voices->count; lane += audio_voice_lanes) {
+        AudioVoicePhase phase = *(AudioVoicePhase const*)&voices->phase[lane];
+        AudioVoicePhase increment = *(AudioVoicePhase const*)&voices->increment[lane];
+        AudioVoiceLane gain = *(AudioVoiceLane const*)&voices->gain[lane];
+        AudioVoiceLane envelope = *(AudioVoiceLane const*)&voices->envelope[lane];
+        AudioVoiceLane envelope_step = *(AudioVoiceLane const*)&voices->envelope_step[lane];
+        AUAudioID const* sample = &voices->sample[lane];
+        i64 position[audio_voice_lanes];
+        memcpy(position, &voices->position[lane], sizeof(position));
+
+        // NOTE: Blocks are looked up when a voice crosses into one, not per
+        //       frame. Two ways keyed by block parity, so a and b straddling
+        //       a block boundary do not evict each other.
+        AUSample const* blocks[audio_voice_lanes][2] = {};
+        i64 block_index[audio_voice_lanes][2];
+        for (u32 i = 0; i < audio_voice_lanes; i += 1) {
+            block_index[i][0] = -1;
+            block_index[i][1] = -1;
+            // Voices still waiting to start never fetch below, load their first block now.
+            if (au_audio_id_is_valid(sample[i]) && position[i] < 0)
+                au_audio_prefetch(audio, sample[i], 0, 0);
+        }
+        auto fetch = [&](u32 i, i64 frame) -> AUSample {
+            if (frame < 0) return 0;
+            i64 block = frame / au_audio_frames_per_block;
+            u32 way = (u32)(block & 1);
+            if (block_index[i][way] != block) {
+                block_index[i][way] = block;
+                blocks[i][way] = au_audio_block_samples(audio, sample[i], frame, 0);
+            }
+            if (!blocks[i][way]) return 0; // Not ready.
+            return blocks[i][way][frame % au_audio_frames_per_block];
+        };
+
+        for (u32 frame = 0; frame < frame_count; frame += 1) {
+            // NOTE: Fetching is a gather, everything after it runs on all lanes at once.
+            AudioVoiceLane a = lane_zero;
+            AudioVoiceLane b = lane_zero;
+            for (u32 i = 0; i < audio_voice_lanes; i += 1) {
+                if (!au_audio_id_is_valid(sample[i])) continue;
+                a[i] = fetch(i, position[i]);
+                b[i] = phase[i] == 0.0 ? a[i] : fetch(i, position[i] + 1);
+            }
+            AudioVoiceLane fraction = __builtin_convertvector(phase, AudioVoiceLane);
+            AudioVoiceLane mixed = (a + (b - a) * fraction) * gain * envelope;
+            AUSample sum = 0;
+            for (u32 i = 0; i < audio_voice_lanes; i += 1)
+                sum += mixed[i];
+            out[frame] += sum;
+
+            envelope = __builtin_elementwise_min(__builtin_elementwise_max(envelope + envelope_step, lane_zero), lane_one);
+            phase += increment;
+            for (u32 i = 0; i < audio_voice_lanes; i += 1) {
+                f64 whole = __builtin_floor(phase[i]);
+                position[i] += (i64)whole;
+                phase[i] -= whole;
+            }
+        }
+
+        *(AudioVoicePhase*)&voices->phase[lane] = phase;
+        *(AudioVoiceLane*)&voices->envelope[lane] = envelope;
+        memcpy(&voices->position[lane], position, sizeof(position));
+    }
+
+    // NOTE: Stage changes happen at block rate, within a block the envelope is clamped instead.
+    for (u32 i = 0; i < voices->count;) {
+        if (voice_is_done(voices, audio, i)) {
+            remove_voice(voices, i);
+            continue;
+        }
+        if (voices->stage[i] == AudioEnvelopeStage_Attack && voices->envelope[i] >= 1.0) {
+            voices->stage[i] = AudioEnvelopeStage_Sustain;
+            voices->envelope_step[i] = 0.0;
+        }
+        i += 1;
+    }
+}
+
+static u32 clamp_budget(u32 budget)
+{
+    if (budget == 0) return 1;
+    if (budget > audio_voice_max) return audio_voice_max;
+    return budget;
+}
+
+static u32 pick_victim(AudioVoices const* voices, AudioVoiceSteal steal)
+{
+    VERIFY(voices->count > 0);
+    u32 victim = 0;
+    switch (steal) {
+    case AudioVoiceSteal_Never:
+    case AudioVoiceSteal_Oldest:
+        for (u32 i = 1; i < voices->count; i++) {
+            if (voices->started[i] < voices->started[victim])
+                victim = i;
+        }
+        return victim;
+    case AudioVoiceSteal_Quietest:
+        for (u32 i = 1; i < voices->count; i++) {
+            AUSample level = voices->gain[i] * voices->envelope[i];
+            AUSample victim_level = voices->gain[victim] * voices->envelope[victim];
+            if (level < victim_level)
+                victim = i;
+        }
+        return victim;
+    }
+    return victim;
+}
+
+static bool voice_is_done(AudioVoices const* voices, AUAudioManager* audio, u32 index)
+{
+    switch (voices->stage[index]) {
+    case AudioEnvelopeStage_Off: return true;
+    case AudioEnvelopeStage_Release:
+        if (voices->envelope[index] <= 0.0) return true;
+        break;
+    case AudioEnvelopeStage_Attack:
+    case AudioEnvelopeStage_Sustain:
+        break;
+    }
+
+    u64 frame_count = au_audio_frame_count(audio, voices->sample[index]);
+    if (frame_count == 0)
+        return voices->position[index] >= pending_sample_frames_max;
+    return voices->position[index] >= (i64)frame_count;
+}
+
+static void remove_voice(AudioVoices* voices, u32 index)
+{
+    VERIFY(index < voices->count);
+    u32 last = voices->count - 1;
+    if (index != last) {
+        voices->phase[index] = voices->phase[last];
+        voices->increment[index] = voices->increment[last];
+        voices->gain[index] = voices->gain[last];
+        voices->envelope[index] = voices->envelope[last];
+        voices->envelope_step[index] = voices->envelope_step[last];
+        voices->position[index] = voices->position[last];
+        voices->sample[index] = voices->sample[last];
+        voices->started[index] = voices->started[last];
+        voices->stage[index] = voices->stage[last];
+    }
+    clear_voice(voices, last);
+    voices->count = last;
+}
+
+static void clear_voice(AudioVoices* voices, u32 index)
+{
+    // NOTE: Lanes past count are still rendered, so they must stay silent.
+    voices->phase[index] = 0.0;
+    voices->increment[index] = 0.0;
+    voices->gain[index] = 0.0;
+    voices->envelope[index] = 0.0;
+    voices->envelope_step[index] = 0.0;
+    voices->position[index] = 0;
+    voices->sample[index] = au_audio_id_null;
+    voices->started[index] = 0;
+    voices->stage[index] = AudioEnvelopeStage_Off;
+}
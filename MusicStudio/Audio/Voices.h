@@ -0,0 +1,65 @@
+#pragma once
+#include <Basic/Types.h>
+#include <Basic/Bits.h>
+
+#include <LibAudio/AudioManager.h>
+
+constexpr u32 audio_voice_max = 256;
+constexpr u32 audio_voice_lanes = 32 / sizeof(AUSample); // One 256 bit register of samples.
+static_assert(audio_voice_max % audio_voice_lanes == 0);
+
+// NOTE: Levels run in the internal sample type, source positions stay f64
+//       so long samples do not drift when mixing in f32.
+typedef AUSample __attribute__((ext_vector_type(audio_voice_lanes))) AudioVoiceLane;
+typedef f64 __attribute__((ext_vector_type(audio_voice_lanes))) AudioVoicePhase;
+static_assert(sizeof(AudioVoiceLane) == audio_voice_lanes * sizeof(AUSample));
+
+typedef enum AudioEnvelopeStage : u8 {
+    AudioEnvelopeStage_Off = 0,
+    AudioEnvelopeStage_Attack,
+    AudioEnvelopeStage_Sustain,
+    AudioEnvelopeStage_Release,
+} AudioEnvelopeStage;
+
+typedef enum AudioVoiceSteal : u8 {
+    AudioVoiceSteal_Oldest,   // Replace the voice that was started first.
+    AudioVoiceSteal_Quietest, // Replace the voice with the lowest gain * envelope.
+    AudioVoiceSteal_Never,    // Drop the new voice.
+} AudioVoiceSteal;
+
+typedef struct AudioVoiceSpec {
+    AUAudioID sample;
+    f64 gain;
+    f64 increment;      // Source frames per output frame.
+    f64 start_offset;   // Output frames into the block before the voice starts, may be fractional.
+    f64 attack_frames;  // 0 starts at full level.
+} AudioVoiceSpec;
+
+// NOTE: Structure of arrays, active voices are kept packed in [0, count) so
+//       render can walk them audio_voice_lanes at a time.
+typedef struct AudioVoices {
+    u64 version; // sizeof(*this)
+
+    u32 count;
+    u32 budget; // Upper bound for count, this is what keeps the callback time bounded.
+    AudioVoiceSteal steal;
+    u64 serial;
+
+    alignas(64) f64 phase[audio_voice_max]; // Fractional source frame, 0..1
+    alignas(64) f64 increment[audio_voice_max];
+    alignas(64) AUSample gain[audio_voice_max];
+    alignas(64) AUSample envelope[audio_voice_max];
+    alignas(64) AUSample envelope_step[audio_voice_max];
+    alignas(64) i64 position[audio_voice_max]; // Integer source frame, negative while waiting to start.
+    alignas(64) AUAudioID sample[audio_voice_max];
+    alignas(64) u64 started[audio_voice_max];
+    alignas(64) AudioEnvelopeStage stage[audio_voice_max];
+} AudioVoices;
+
+C_API void audio_voices_init(AudioVoices*, u32 budget, AudioVoiceSteal);
+C_API void audio_voices_configure(AudioVoices*, u32 budget, AudioVoiceSteal);
+
+C_API [[nodiscard]] bool audio_voices_trigger(AudioVoices*, AudioVoiceSpec);
+C_API void audio_voices_release(AudioVoices*, AUAudioID sample, f64 release_frames);
+
+C_API void audio_voices_render(AudioVoices*, AUAudioManager*, AUSample* out, u32 frame_count);
@@ -8,6 +8,7 @@
 #include <Basic/Context.h>
 #include <Basic/Defer.h>
 #include <Basic/Mailbox.h>
+#include <Basic/MemoryPoker.h>
 #include <Basic/PageAllocator.h>
 #include <Basic/Verify.h>
 
@@ -24,6 +25,7 @@
 #include <Shaders/Shaders.h>
 
 #include <stdlib.h>
+#include <string.h>
 #include <math.h>
 #include <pthread.h>
 
@@ -45,6 +47,8 @@ static void trans_init(State*, TransState*);
 static SoundIoOutStream* create_default_outstream(State*, SoundIo*);
 
 static void audio_frame(SoundIoOutStream *outstream, int frame_count_min, int frame_count_max) noexcept [[clang::nonblocking]];
+static bool pick_outstream_format(SoundIoDevice*, SoundIoFormat*);
+static void write_channel_area(SoundIoFormat, SoundIoChannelArea*, AUSample const* source, u32 frame_count) noexcept [[clang::nonblocking]];
 
 C_API void state_init(State* state, StateFlags flags)
 {
@@ -74,13 +78,18 @@ static SoundIoOutStream* create_default_outstream(State* state, SoundIo* soundio
     auto* device = soundio_get_output_device(soundio, index);
     device->software_latency_max = state->persisted.sections.settings->max_latency;
     device->software_latency_min = 0;
+    SoundIoFormat format;
+    if (!pick_outstream_format(device, &format)) {
+        errorf("output device does not support any known sample format");
+        return nullptr;
+    }
     auto* outstream = soundio_outstream_create(device);
     if (!outstream) {
         errorf("could not create outstream");
         return nullptr;
     }
     outstream->userdata = state;
-    outstream->format = SoundIoFormatFloat64NE;
+    outstream->format = format;
     outstream->write_callback = audio_frame;
     outstream->sample_rate = (i32)state->persisted.sections.settings->frames_per_second;
     outstream->error_callback = [](SoundIoOutStream*, int err){
@@ -115,8 +124,33 @@ static void audio_frame(SoundIoOutStream* outstream, int, int frame_count_max) n
     };
     set_context(&context);
 
+    // NOTE: CoreAudio already runs this thread with a time constraint
+    //       policy, only prefault the stack, a policy change would drop it.
+    static thread_local bool is_profiled = false;
+    if (!is_profiled) {
+        is_profiled = true;
+        (void)th_thread_apply_options((THThreadOptions){ .prefault_stack = true });
+    }
+
+#if !defined(NDEBUG) && defined(__linux__)
+    // NOTE: Everything the callback touches should be prefaulted and kept
+    //       resident by the memory poker, a fault here is a missed page.
+    //       Only where faults are counted per thread, elsewhere the count
+    //       includes every other thread's faults.
+    MemoryFaultCount faults_before = memory_fault_count_thread();
+    defer [=] {
+        MemoryFaultCount faults_after = memory_fault_count_thread();
+        u64 minor = faults_after.minor - faults_before.minor;
+        u64 major = faults_after.major - faults_before.major;
+        if (minor || major)
+            warnf("audio callback took %lu minor and %lu major page faults", minor, major);
+    };
+#endif
+
     int frames_left = frame_count_max;
     for (;;) {
+        reset_temporary_arena_quiet();
+
         int frame_count = frames_left;
         if (auto err = soundio_outstream_begin_write(outstream, &areas, &frame_count)) {
             fatalf("unrecoverable stream error: %s", soundio_strerror(err));
@@ -125,22 +159,25 @@ static void audio_frame(SoundIoOutStream* outstream, int, int frame_count_max) n
         if (!frame_count)
             break;
 
-        VERIFY(((u32)frame_count_max) <= ARRAY_SIZE(stable->channel_buffer[0]));
-        f64* channels[au_audio_channel_max] = {};
         auto* layout = &outstream->layout;
-        for (i32 i = 0; i < layout->channel_count; i++)
-            channels[i] = stable->channel_buffer[0];
-        memzero(stable->channel_buffer, layout->channel_count * sizeof(stable->channel_buffer[0]));
-
-        actor->audio_frame(persisted, stable, trans, channels, frame_count_max, layout->channel_count);
-        for (int channel = 0; channel < layout->channel_count; channel += 1) {
-            for (int frame = 0; frame < frame_count_max; frame += 1) {
-                static_assert(sizeof(channels[channel][frame]) == 8);
-                *((f64*)areas[channel].ptr) = channels[channel][frame];
-                areas[channel].ptr += areas[channel].step;
-            }
+        u32 channel_count = (u32)layout->channel_count;
+        VERIFY(channel_count <= ARRAY_SIZE(stable->channel_buffer));
+        VERIFY(((u32)frame_count) <= ARRAY_SIZE(stable->channel_buffer[0]));
+
+        AUSample* channels[au_audio_channel_max] = {};
+        for (u32 channel = 0; channel < channel_count; channel++) {
+            channels[channel] = stable->channel_buffer[channel];
+            memzero(channels[channel], frame_count * sizeof(*channels[channel]));
         }
 
+        actor->audio_frame(persisted, stable, trans, (AudioBuses){
+            .channels = channels,
+            .channel_count = channel_count,
+            .frame_count = (u32)frame_count,
+        });
+        for (u32 channel = 0; channel < channel_count; channel++)
+            write_channel_area(outstream->format, &areas[channel], channels[channel], (u32)frame_count);
+
         if (auto err = soundio_outstream_end_write(outstream)) {
             if (err == SoundIoErrorUnderflow)
                 return;
@@ -153,6 +190,63 @@ static void audio_frame(SoundIoOutStream* outstream, int, int frame_count_max) n
     }
 }
 
+static bool pick_outstream_format(SoundIoDevice* device, SoundIoFormat* out)
+{
+    // NOTE: Prefer the internal sample type so writing out is a plain copy,
+    //       otherwise take whatever the device has natively and convert.
+    static constexpr SoundIoFormat preferred[] = {
+#if AU_SAMPLE_F32
+        SoundIoFormatFloat32NE,
+        SoundIoFormatFloat64NE,
+#else
+        SoundIoFormatFloat64NE,
+        SoundIoFormatFloat32NE,
+#endif
+        SoundIoFormatS32NE,
+        SoundIoFormatS16NE,
+    };
+    for (u32 i = 0; i < ARRAY_SIZE(preferred); i += 1) {
+        if (soundio_device_supports_format(device, preferred[i])) {
+            *out = preferred[i];
+            return true;
+        }
+    }
+    return false;
+}
+
+template <typename T>
+static void write_channel_area_as(SoundIoChannelArea* area, AUSample const* source, u32 frame_count, f64 scale) noexcept [[clang::nonblocking]]
+{
+    if (area->step == sizeof(T) && sizeof(T) == sizeof(*source) && scale == 0.0) {
+        memcpy(area->ptr, source, frame_count * sizeof(*source));
+        return;
+    }
+
+    // NOTE: Interleaved device, every channel is strided by the frame size.
+    char* dest = area->ptr;
+    for (u32 frame = 0; frame < frame_count; frame += 1) {
+        T* sample = (T*)(dest + (u64)frame * (u64)area->step);
+        if (scale == 0.0) {
+            *sample = (T)source[frame];
+        } else {
+            f64 clamped = __builtin_fmin(__builtin_fmax((f64)source[frame], -1.0), 1.0);
+            *sample = (T)(clamped * scale);
+        }
+    }
+}
+
+static void write_channel_area(SoundIoFormat format, SoundIoChannelArea* area, AUSample const* source, u32 frame_count) noexcept [[clang::nonblocking]]
+{
+    // NOTE: A scale of 0 means float, stored as is.
+    switch (format) {
+    case SoundIoFormatFloat64NE: return write_channel_area_as<f64>(area, source, frame_count, 0.0);
+    case SoundIoFormatFloat32NE: return write_channel_area_as<f32>(area, source, frame_count, 0.0);
+    case SoundIoFormatS32NE: return write_channel_area_as<i32>(area, source, frame_count, 2147483647.0);
+    case SoundIoFormatS16NE: return write_channel_area_as<i16>(area, source, frame_count, 32767.0);
+    default: break;
+    }
+}
+
 C_API void layout_frame(StableLayout* stable, TransLayout* trans, UIWindow* window, THMessageQueue* layout_render_command_sink)
 {
     VERIFY(ty_is_initialized(stable));
@@ -514,6 +608,8 @@ static void stable_audio_init(State* state, StableState* stable, StateFlags flag
     if (!au_audio_manager_init(&audio->audio_manager, &stable->main.memory_poker))
         fatalf("could not initialize audio manager");
 
+    audio_voices_init(&audio->voices, flags.voice_budget ? flags.voice_budget : 64, AudioVoiceSteal_Oldest);
+
     audio->actor = (AudioActor const*)&stable->actor_reloader.audio.dispatch;
     VERIFY(audio->actor != nullptr);
 
@@ -543,8 +639,15 @@ C_API [[nodiscard]] bool main_start(State* state)
 {
     VERIFY(ty_is_initialized(&state->stable.main));
 
-    if (!state->stable.main.memory_poker.start())
+    auto* memory_poker = &state->stable.main.memory_poker;
+    if (!memory_poker->start())
         errorf("could not start main memory poker");
+    for (u64 i = 0; i < memory_poker->count; i++) {
+        auto stats = memory_poker->range_stats(i);
+        infof("memory poker range %lu: %lu/%lu pages resident, %s, %lu minor %lu major faults to prefault", i,
+            stats.resident_pages, stats.page_count, stats.is_locked ? "locked" : "kept warm",
+            stats.prefault.minor, stats.prefault.major);
+    }
     return true;
 }
 
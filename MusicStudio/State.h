@@ -3,6 +3,7 @@
 
 #include "./UI/UI.h"
 #include "./Audio/Audio.h"
+#include "./Audio/Voices.h"
 
 #include <Basic/Allocator.h>
 #include <Basic/Arena.h>
@@ -51,6 +52,7 @@ typedef struct {
     bool use_auto_reload : 1;
     bool use_audio : 1;
     bool use_ui : 1;
+    u16 voice_budget; // 0 picks the default.
 } StateFlags;
 
 typedef enum SystemID : u8 {
@@ -153,8 +155,9 @@ typedef struct StableAudio {
     SoundIoOutStream* outstream;
 
     AUAudioManager audio_manager;
+    AudioVoices voices;
 
-    f64 channel_buffer[au_audio_channel_max][4096];
+    alignas(64) AUSample channel_buffer[au_audio_channel_max][4096]; // planar, one bus per channel
 } StableAudio;
 
 typedef struct StableState {
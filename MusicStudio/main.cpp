@@ -18,6 +18,8 @@
 
 #include "./State.h"
 
+#include <stdlib.h>
+
 ErrorOr<int> Main::main(int argc, c_string argv[])
 {
     auto argument_parser = CLI::ArgumentParser();
@@ -31,6 +33,7 @@ ErrorOr<int> Main::main(int argc, c_string argv[])
         .use_auto_reload = true,
         .use_audio = false,
         .use_ui = false,
+        .voice_budget = 0,
     };
 
     TRY(argument_parser.add_flag("--no-actor-reload", "-nar", "disable reload of actors", [&]{
@@ -45,15 +48,23 @@ ErrorOr<int> Main::main(int argc, c_string argv[])
         flags.use_ui = true;
     }));
 
+    TRY(argument_parser.add_option("--voice-budget"sv, "-vb"sv, "count"sv, "voices playing at once before the oldest is stolen (default: 64)"sv, [&](c_string arg) {
+        flags.voice_budget = (u16)strtoul(arg, nullptr, 10);
+    }));
+
     if (auto result = argument_parser.run(argc, argv); result.is_error()) {
         TRY(result.error().show());
         return 1;
     }
 
-    State* state = (State*)page_alloc(sizeof(*state));
+    // NOTE: State is tens of MiB touched from every thread, back it with
+    //       huge pages so walking it does not thrash the TLB.
+    State* state = (State*)page_alloc_huge(sizeof(*state), PageHugeMode_Transparent);
     static_assert(sizeof(*state) < 96 * MiB);
     VERIFY(state != nullptr);
     state_init(state, flags);
+    auto huge = page_huge_report(state, sizeof(*state));
+    infof("state: %lu MiB, %lu huge pages%s", huge.size / MiB, huge.huge_pages, huge.is_explicit ? " (explicit)" : "");
     if (!flags.use_audio && !flags.use_ui)
         return 0;
     if (!main_start(state))
@@ -0,0 +1,132 @@
+#include <Basic/MPSCMailbox.h>
+#include <LibCLI/ArgumentParser.h>
+#include <LibCore/Time.h>
+#include <LibMain/Main.h>
+
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+static constexpr u32 thread_max = 256;
+
+DEFINE_MESSAGE(Ticket) {
+    u32 producer;
+    u64 sequence;
+};
+
+typedef struct {
+    MPSCMailbox* mailbox;
+    u32 producer;
+    u64 count;
+    u64 full; // Posts that found the ring full and had to try again.
+} Producer;
+
+static void* produce(void* user)
+{
+    auto* producer = (Producer*)user;
+    for (u64 i = 0; i < producer->count;) {
+        auto result = producer->mailbox->post((Ticket){
+            .producer = producer->producer,
+            .sequence = i,
+        });
+        if (result.ok) {
+            i += 1;
+            continue;
+        }
+        if (result.code.system != ksystem_unix || result.code.unix != EWOULDBLOCK) {
+            fprintf(stderr, "could not post: %s\n", kerror_strerror(result));
+            abort();
+        }
+        // NOTE: Backing off is up to the caller, the mailbox never waits.
+        producer->full += 1;
+        sched_yield();
+    }
+    return nullptr;
+}
+
+ErrorOr<int> Main::main(int argc, c_string argv[])
+{
+    auto argument_parser = CLI::ArgumentParser();
+
+    u64 messages = 1000000;
+    TRY(argument_parser.add_option("--messages"sv, "-m"sv, "count"sv, "messages per producer (default: 1000000)"sv, [&](c_string arg) {
+        messages = strtoull(arg, nullptr, 10);
+    }));
+
+    u32 thread_count = 4;
+    TRY(argument_parser.add_option("--threads"sv, "-t"sv, "count"sv, "producer threads (default: 4)"sv, [&](c_string arg) {
+        thread_count = (u32)strtoul(arg, nullptr, 10);
+    }));
+
+    u32 capacity = 64 * 1024;
+    TRY(argument_parser.add_option("--capacity"sv, "-c"sv, "bytes"sv, "ring size, small rings show contention on a full ring (default: 65536)"sv, [&](c_string arg) {
+        capacity = (u32)strtoul(arg, nullptr, 10);
+    }));
+
+    if (auto result = argument_parser.run(argc, argv); result.is_error()) {
+        TRY(result.error().show());
+        return 1;
+    }
+    if (messages == 0 || capacity == 0) {
+        fprintf(stderr, "messages and capacity must be non zero\n");
+        return 1;
+    }
+    if (thread_count == 0 || thread_count > thread_max) {
+        fprintf(stderr, "threads must be between 1 and %u\n", thread_max);
+        return 1;
+    }
+
+    MPSCMailbox mailbox = {};
+    if (auto error = mpsc_mailbox_init(capacity, &mailbox); !error.ok) {
+        fprintf(stderr, "could not create mailbox: %s\n", kerror_strerror(error));
+        return 1;
+    }
+    auto* reader = mailbox.reader();
+
+    static Producer producers[thread_max];
+    static pthread_t threads[thread_max];
+    static u64 next_sequence[thread_max];
+
+    u64 start = core_time_monotonic_ns();
+    for (u32 i = 0; i < thread_count; i++) {
+        producers[i] = (Producer){
+            .mailbox = &mailbox,
+            .producer = i,
+            .count = messages,
+            .full = 0,
+        };
+        pthread_create(&threads[i], nullptr, produce, &producers[i]);
+    }
+
+    // NOTE: Each producer posts in order, so every ticket must be the one
+    //       after the last ticket read from the same producer.
+    u64 total = messages * thread_count;
+    u64 received = 0;
+    while (received < total) {
+        reader->wait(10_ms);
+        Ticket ticket;
+        while (reader->read(&ticket).ok) {
+            if (ticket.producer >= thread_count || ticket.sequence != next_sequence[ticket.producer]) {
+                fprintf(stderr, "ticket %lu from producer %u out of order\n", ticket.sequence, ticket.producer);
+                return 1;
+            }
+            next_sequence[ticket.producer] += 1;
+            received += 1;
+        }
+    }
+    u64 elapsed = core_time_monotonic_ns() - start;
+
+    u64 full = 0;
+    for (u32 i = 0; i < thread_count; i++) {
+        pthread_join(threads[i], nullptr);
+        full += producers[i].full;
+    }
+    mpsc_mailbox_deinit(&mailbox);
+
+    printf("messages:   %lu from %u producers into %u bytes\n", received, thread_count, capacity);
+    printf("throughput: %.2f Mmsg/s, %.1f ns/msg\n", (f64)received / ((f64)elapsed / 1e3), (f64)elapsed / (f64)received);
+    printf("full:       %lu posts rejected with EWOULDBLOCK (%.2f per message)\n", full, (f64)full / (f64)received);
+    return 0;
+}
@@ -0,0 +1,111 @@
+#include <Basic/ObjectPool.h>
+#include <LibCLI/ArgumentParser.h>
+#include <LibCore/Time.h>
+#include <LibMain/Main.h>
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+// NOTE: Size of a Promise slot, the smallest of the objects this is meant for.
+static constexpr u64 object_size = 64;
+static constexpr u32 live_objects = 256;
+static constexpr u32 thread_max = 1024;
+
+typedef struct {
+    ObjectPool* pool; // nullptr means the system allocator.
+    u64 rounds;
+    u64 elapsed_ns;
+} Worker;
+
+static void* work(void* user)
+{
+    auto* worker = (Worker*)user;
+    void* live[live_objects];
+
+    // NOTE: Allocate a batch, touch it, free it in a different order, the
+    //       pattern of message and block churn in the audio and UI threads.
+    u64 start = core_time_monotonic_ns();
+    for (u64 round = 0; round < worker->rounds; round++) {
+        for (u32 i = 0; i < live_objects; i++) {
+            live[i] = worker->pool ? object_pool_alloc(worker->pool) : malloc(object_size);
+            *(u64*)live[i] = round;
+        }
+        for (u32 i = 0; i < live_objects; i++) {
+            void* object = live[(i * 7) % live_objects];
+            if (worker->pool) object_pool_free(worker->pool, object);
+            else free(object);
+        }
+    }
+    worker->elapsed_ns = core_time_monotonic_ns() - start;
+
+    if (worker->pool) object_pool_flush_thread_cache(worker->pool);
+    return nullptr;
+}
+
+static void run(c_string name, ObjectPool* pool, u32 thread_count, u64 rounds)
+{
+    static pthread_t threads[thread_max];
+    static Worker workers[thread_max];
+    for (u32 i = 0; i < thread_count; i++) {
+        workers[i] = (Worker){ .pool = pool, .rounds = rounds, .elapsed_ns = 0 };
+        pthread_create(&threads[i], nullptr, work, &workers[i]);
+    }
+
+    u64 elapsed = 0;
+    for (u32 i = 0; i < thread_count; i++) {
+        pthread_join(threads[i], nullptr);
+        if (workers[i].elapsed_ns > elapsed) elapsed = workers[i].elapsed_ns;
+    }
+
+    f64 operations = (f64)rounds * live_objects * 2 * thread_count;
+    printf("%-8s %4u threads: %6.2f ns/op, %8.2f Mop/s\n", name, thread_count, (f64)elapsed / (operations / thread_count), operations / ((f64)elapsed / 1e3));
+}
+
+ErrorOr<int> Main::main(int argc, c_string argv[])
+{
+    auto argument_parser = CLI::ArgumentParser();
+
+    u64 rounds = 20000;
+    TRY(argument_parser.add_option("--rounds"sv, "-r"sv, "count"sv, "alloc/free rounds per thread (default: 20000)"sv, [&](c_string arg) {
+        rounds = strtoull(arg, nullptr, 10);
+    }));
+
+    u32 thread_count = 4;
+    TRY(argument_parser.add_option("--threads"sv, "-t"sv, "count"sv, "threads for the contended run (default: 4)"sv, [&](c_string arg) {
+        thread_count = (u32)strtoul(arg, nullptr, 10);
+    }));
+
+    u32 repeat = 4;
+    TRY(argument_parser.add_option("--repeat"sv, "-R"sv, "count"sv, "contended runs, each with fresh threads (default: 4)"sv, [&](c_string arg) {
+        repeat = (u32)strtoul(arg, nullptr, 10);
+    }));
+
+    if (auto result = argument_parser.run(argc, argv); result.is_error()) {
+        TRY(result.error().show());
+        return 1;
+    }
+    if (thread_count == 0 || thread_count > thread_max) {
+        fprintf(stderr, "threads must be between 1 and %u\n", thread_max);
+        return 1;
+    }
+
+    static ObjectPool pool = {};
+    if (auto result = object_pool_init(&pool, object_size, 16, live_objects * thread_count + object_pool_cache_size * thread_count); !result.ok) {
+        fprintf(stderr, "could not create pool: %s\n", kerror_tstring(result));
+        return 1;
+    }
+
+    run("malloc", nullptr, 1, rounds);
+    run("pool", &pool, 1, rounds);
+    // NOTE: Threads past object_pool_thread_max run without a cache, and
+    //       every repeat spawns new threads that take over the cache slots
+    //       of the ones that exited.
+    for (u32 i = 0; i < repeat; i++) {
+        run("malloc", nullptr, thread_count, rounds);
+        run("pool", &pool, thread_count, rounds);
+    }
+
+    object_pool_deinit(&pool);
+    return 0;
+}
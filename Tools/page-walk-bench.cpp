@@ -0,0 +1,114 @@
+#include <Basic/Bits.h>
+#include <Basic/PageAllocator.h>
+#include <LibCLI/ArgumentParser.h>
+#include <LibCore/Time.h>
+#include <LibMain/Main.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+
+static constexpr u64 small_page_size = 4 * KiB;
+
+static void shuffle(u32* order, u32 count)
+{
+    u64 state = 0x9E3779B97F4A7C15;
+    for (u32 i = count - 1; i > 0; i--) {
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+        u32 j = (u32)(state % (i + 1));
+        u32 tmp = order[i];
+        order[i] = order[j];
+        order[j] = tmp;
+    }
+}
+
+// NOTE: One load per 4 KiB page in random order, so nearly every access is a
+//       TLB miss with regular pages and a hit with huge pages.
+static void walk(c_string name, u8* memory, u64 size, bool huge, u32 const* order, u32 passes)
+{
+    for (u64 i = 0; i < size; i += small_page_size)
+        memory[i] = (u8)i;
+
+    u32 pages = (u32)(size / small_page_size);
+    u64 sum = 0;
+    u64 start = core_time_monotonic_ns();
+    for (u32 pass = 0; pass < passes; pass++) {
+        for (u32 i = 0; i < pages; i++)
+            sum += *(u8 volatile*)&memory[(u64)order[i] * small_page_size];
+    }
+    u64 elapsed = core_time_monotonic_ns() - start;
+
+    u64 huge_pages = 0;
+    bool is_explicit = false;
+    if (huge) {
+        auto report = page_huge_report(memory, size);
+        huge_pages = report.huge_pages;
+        is_explicit = report.is_explicit;
+    }
+    printf("%-12s %6.2f ns/access, %5lu huge pages%s (checksum %lu)\n", name, (f64)elapsed / ((f64)pages * passes), huge_pages, is_explicit ? " explicit" : "", sum);
+}
+
+ErrorOr<int> Main::main(int argc, c_string argv[])
+{
+    auto argument_parser = CLI::ArgumentParser();
+
+    u64 size_mib = 256;
+    TRY(argument_parser.add_option("--size"sv, "-s"sv, "MiB"sv, "bytes to walk in MiB (default: 256)"sv, [&](c_string arg) {
+        size_mib = strtoull(arg, nullptr, 10);
+    }));
+
+    u32 passes = 8;
+    TRY(argument_parser.add_option("--passes"sv, "-p"sv, "count"sv, "walks over the whole range (default: 8)"sv, [&](c_string arg) {
+        passes = (u32)strtoul(arg, nullptr, 10);
+    }));
+
+    if (auto result = argument_parser.run(argc, argv); result.is_error()) {
+        TRY(result.error().show());
+        return 1;
+    }
+    if (size_mib == 0 || passes == 0) {
+        fprintf(stderr, "size and passes must be non zero\n");
+        return 1;
+    }
+
+    u64 size = __builtin_align_up(size_mib * MiB, page_huge_size);
+    u32 pages = (u32)(size / small_page_size);
+    u32* order = (u32*)malloc(pages * sizeof(u32));
+    if (!order) {
+        fprintf(stderr, "could not allocate walk order\n");
+        return 1;
+    }
+    for (u32 i = 0; i < pages; i++)
+        order[i] = i;
+    shuffle(order, pages);
+
+    u8* regular = (u8*)page_alloc(size);
+    if (!regular) {
+        fprintf(stderr, "could not allocate %lu MiB\n", size / MiB);
+        return 1;
+    }
+    walk("regular", regular, size, false, order, passes);
+    page_free(regular, size);
+
+    u8* transparent = (u8*)page_alloc_huge(size, PageHugeMode_Transparent);
+    if (!transparent) {
+        fprintf(stderr, "could not allocate %lu MiB of transparent huge pages\n", size / MiB);
+        return 1;
+    }
+    walk("transparent", transparent, size, true, order, passes);
+    page_free_huge(transparent, size);
+
+    // NOTE: Falls back to transparent huge pages when no hugetlbfs pages
+    //       are reserved (/proc/sys/vm/nr_hugepages), the report shows which.
+    u8* explicit_huge = (u8*)page_alloc_huge(size, PageHugeMode_Explicit);
+    if (!explicit_huge) {
+        fprintf(stderr, "could not allocate %lu MiB of explicit huge pages\n", size / MiB);
+        return 1;
+    }
+    walk("explicit", explicit_huge, size, true, order, passes);
+    page_free_huge(explicit_huge, size);
+
+    free(order);
+    return 0;
+}
@@ -11,6 +11,7 @@
 #include <LibCore/Print.h>
 #include <LibCore/Time.h>
 #include <LibMain/Main.h>
+#include <LibMusic/DelayCompensation.h>
 #include <LibMusic/Project.h>
 #include <LibMusic/VstPlugin.h>
 #include <LibMusic/WASMPluginManager.h>
@@ -24,6 +25,7 @@
 #include <SoundIo/SoundIo.h>
 
 #include <MacTypes.h>
+#include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 
@@ -48,6 +50,19 @@ struct AudioContext {
     f64* scratch2;
 };
 
+// NOTE: The unprocessed input summed back in with the plugin chain. Two
+//       sets of delay lines, the audio thread runs the active one while the
+//       main thread updates the other after a latency change, so lines are
+//       never resized under the callback.
+struct DryMix {
+    f64 gain;
+    f64* dry[SOUNDIO_MAX_CHANNELS];
+    f64* wet[SOUNDIO_MAX_CHANNELS];
+    MS::DelayCompensation compensation[2];
+    _Atomic u32 active;
+    _Atomic u32 in_use; // Last one the audio thread picked up.
+};
+
 static SmallCapture<void(f64*, f64*, usize, usize)> vst2_process_audio(FixedArena* arena, MS::Plugin* plugin);
 
 ErrorOr<int> Main::main(int argc, c_string argv[]) {
@@ -68,6 +83,11 @@ ErrorOr<int> Main::main(int argc, c_string argv[]) {
         MUST(vst2_plugin_paths.append(arg));
     }));
 
+    f64 dry_gain = 0.0;
+    TRY(argument_parser.add_option("--dry", "-d", "gain", "mix the unprocessed input back in, delayed to line up with the plugins", [&](c_string arg) {
+        dry_gain = strtod(arg, nullptr);
+    }));
+
     if (auto result = argument_parser.run(argc, argv); result.is_error()) {
         TRY(result.error().show());
         return 1;
@@ -148,6 +168,18 @@ ErrorOr<int> Main::main(int argc, c_string argv[]) {
         }
     }
 
+    // NOTE: WASM plugins are asked once here, before the audio thread owns
+    //       them. VST plugins report changes through the host as they run.
+    u32 wasm_latency = 0;
+    for (auto& plugin : wasm_plugin_manager.plugins())
+        wasm_latency += TRY(plugin.latency());
+    auto chain_latency = [&] {
+        u32 latency = wasm_latency;
+        for (auto& plugin : vst2_plugins)
+            latency += plugin.latency();
+        return latency;
+    };
+
     SoundIo *soundio = soundio_create();
     if (!soundio) {
         return Error::from_errno(ENOMEM);
@@ -179,6 +211,7 @@ ErrorOr<int> Main::main(int argc, c_string argv[]) {
     auto audio_pipeline = AU::Pipeline();
 
     _Atomic usize played_frames = 0;
+    DryMix dry_mix = { .gain = dry_gain };
 
     TRY(audio_pipeline.pipe([&](f64* out, f64*, usize frames, usize channels) {
         usize played = played_frames;
@@ -186,6 +219,8 @@ ErrorOr<int> Main::main(int argc, c_string argv[]) {
             for (usize channel = 0; channel < channels; channel++) {
                 f64 sample = audio.sample_f64(channel, played + frame);
                 out[frame * channels + channel] = sample;
+                if (dry_mix.gain != 0.0)
+                    dry_mix.dry[channel][frame] = sample;
             }
         }
     }));
@@ -206,6 +241,25 @@ ErrorOr<int> Main::main(int argc, c_string argv[]) {
         TRY(audio_pipeline.pipe(vst2_process_audio(&pipe_arena, &plugin)));
     }
 
+    if (dry_gain != 0.0) {
+        TRY(audio_pipeline.pipe([&](f64* out, f64*, usize frames, usize channels) {
+            u32 index = dry_mix.active;
+            dry_mix.in_use = index;
+            auto* compensation = &dry_mix.compensation[index];
+
+            for (usize frame = 0; frame < frames; frame++) {
+                for (usize channel = 0; channel < channels; channel++)
+                    dry_mix.wet[channel][frame] = out[frame * channels + channel];
+            }
+            compensation->process(0, dry_mix.dry, (u32)channels, (u32)frames);
+            compensation->process(1, dry_mix.wet, (u32)channels, (u32)frames);
+            for (usize frame = 0; frame < frames; frame++) {
+                for (usize channel = 0; channel < channels; channel++)
+                    out[frame * channels + channel] = dry_mix.wet[channel][frame] + dry_mix.gain * dry_mix.dry[channel][frame];
+            }
+        }));
+    }
+
     f64* scratch = arena->alloc<f64>(SOUNDIO_MAX_CHANNELS * (u64)audio.sample_rate);
     if (!scratch) fatalf("could not allocate scratch buffer");
 
@@ -238,6 +292,22 @@ ErrorOr<int> Main::main(int argc, c_string argv[]) {
     if (outstream->layout_error) {
         return Error::from_string_literal(soundio_strerror(outstream->layout_error));
     }
+
+    if (dry_gain != 0.0) {
+        u32 channel_count = (u32)outstream->layout.channel_count;
+        for (u32 channel = 0; channel < channel_count; channel++) {
+            dry_mix.dry[channel] = arena->alloc<f64>(audio.sample_rate);
+            dry_mix.wet[channel] = arena->alloc<f64>(audio.sample_rate);
+            if (!dry_mix.dry[channel] || !dry_mix.wet[channel])
+                return Error::from_string_literal("could not allocate dry mix buffers");
+        }
+        // NOTE: Track 0 is the dry input, track 1 the plugin chain.
+        u32 latencies[] = { 0, chain_latency() };
+        for (auto& compensation : dry_mix.compensation) {
+            compensation = TRY(MS::DelayCompensation::create(arena, 2, channel_count));
+            TRY(compensation.update(View(latencies, 2)));
+        }
+    }
     if (int err = soundio_outstream_start(outstream)) {
         return Error::from_string_literal(soundio_strerror(err));
     }
@@ -248,18 +318,37 @@ ErrorOr<int> Main::main(int argc, c_string argv[]) {
     dprintln("Sample rate: {}", audio.sample_rate);
     dprintln("Channels: {}", audio.channel_count);
     dprintln("Duration: {}", part_time((u32)audio.duration()));
+    dprintln("Plugin latency: {} frames", chain_latency());
     dprintln("----------------------\n");
 
     auto duration = part_time((u32)audio.duration());
     dprint("Time: {} / {}", part_time(0), duration);
+    bool compensation_is_stale = false;
     while (!ui_window_should_close(root_window)) {
         ui_application_poll_events(app);
         if (played_frames >= audio.frame_count) {
             break;
         }
         soundio_flush_events(soundio);
+        bool latency_changed = false;
         for (auto& plugin : vst2_plugins) {
             (void)plugin.vst->editor_idle();
+            latency_changed |= plugin.take_latency_changed();
+        }
+        if (latency_changed) {
+            dprintln("\r\033[KPlugin latency: {} frames", chain_latency());
+            compensation_is_stale = dry_gain != 0.0;
+        }
+
+        // NOTE: Only touch the idle set once the audio thread has moved on
+        //       to the active one, otherwise try again next time around.
+        if (compensation_is_stale && dry_mix.in_use == dry_mix.active) {
+            u32 next = 1 - dry_mix.active;
+            u32 latencies[] = { 0, chain_latency() };
+            TRY(dry_mix.compensation[next].update(View(latencies, 2)));
+            dry_mix.compensation[next].clear();
+            dry_mix.active = next;
+            compensation_is_stale = false;
         }
 
         auto current_time = part_time(played_frames / audio.sample_rate);
@@ -270,6 +359,8 @@ ErrorOr<int> Main::main(int argc, c_string argv[]) {
     dprintln("\r\033[KTime: {} / {}", duration, duration);
 
     soundio_outstream_destroy(outstream);
+    for (auto& compensation : dry_mix.compensation)
+        compensation.destroy();
     soundio_device_unref(device);
     soundio_destroy(soundio);
     return 0;
@@ -0,0 +1,191 @@
+#include <Basic/MPSCMailbox.h>
+#include <Basic/Mailbox.h>
+#include <Basic/RPCServer.h>
+#include <LibCLI/ArgumentParser.h>
+#include <LibCore/Time.h>
+#include <LibMain/Main.h>
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+static constexpr u32 batch_max = 512;
+static_assert(batch_max <= rpc_capacity);
+
+DEFINE_MESSAGE(Square) {
+    u64 value;
+};
+
+DEFINE_MESSAGE(Stop) {
+    u8 unused;
+};
+
+static Mailbox worker_mailbox;
+static RPCServer server;
+static MPSCMailbox completions;
+
+static void* worker(void*)
+{
+    auto* reader = worker_mailbox.reader();
+    for (;;) {
+        reader->wait();
+        u16 tag = 0;
+        while (reader->peek(&tag).found) {
+            if (tag == Ty2::type_id<Stop>()) {
+                reader->toss(tag);
+                return nullptr;
+            }
+            RPCRequest request;
+            if (!reader->read(&request).ok) {
+                fprintf(stderr, "unexpected message tag %u\n", tag);
+                abort();
+            }
+            Square square;
+            if (!request.promise->read(&square).ok) {
+                request.promise->reject();
+                continue;
+            }
+            request.promise->resolve((Square){ .value = square.value * square.value });
+        }
+    }
+}
+
+static bool check(Promise* promise, u64 value)
+{
+    Square square;
+    if (!promise->is_resolved() || !promise->read(&square).ok || square.value != value * value) {
+        fprintf(stderr, "wrong reply for %lu\n", value);
+        return false;
+    }
+    promise->toss();
+    return true;
+}
+
+// NOTE: One request in flight, the caller parks in wait() until the worker
+//       resolves it, the shape of a blocking call to another thread.
+static bool run_await(u64 rounds)
+{
+    u64 start = core_time_monotonic_ns();
+    for (u64 i = 0; i < rounds; i++) {
+        Promise* promise = server.request((Square){ .value = i });
+        if (!promise) {
+            fprintf(stderr, "could not request\n");
+            return false;
+        }
+        if (!promise->wait()) {
+            fprintf(stderr, "wait timed out without a timeout\n");
+            return false;
+        }
+        if (!check(promise, i))
+            return false;
+    }
+    u64 elapsed = core_time_monotonic_ns() - start;
+    printf("await        %8.1f ns/request\n", (f64)elapsed / (f64)rounds);
+    return true;
+}
+
+// NOTE: Whole batches in flight, submitted with one wakeup and collected
+//       from the completion mailbox in whatever order they settle. A
+//       completion lost to a full mailbox is picked up by polling.
+static bool run_completions(u64 rounds, u32 batch)
+{
+    static Square requests[batch_max];
+    static RPCBatchItem items[batch_max];
+    static Promise* promises[batch_max];
+    static u32 index_of_slot[rpc_capacity];
+    auto* reader = completions.reader();
+
+    u64 lost = 0;
+    u64 start = core_time_monotonic_ns();
+    for (u64 first = 0; first < rounds; first += batch) {
+        u32 count = rounds - first < batch ? (u32)(rounds - first) : batch;
+        for (u32 i = 0; i < count; i++) {
+            requests[i] = (Square){ .value = first + i };
+            items[i] = (RPCBatchItem){
+                .tag = Ty2::type_id<Square>(),
+                .data_size = sizeof(Square),
+                .data_align = alignof(Square),
+                .data = &requests[i],
+            };
+        }
+        if (server.request_many(items, count, &completions, promises) != count) {
+            fprintf(stderr, "could not submit batch\n");
+            return false;
+        }
+        for (u32 i = 0; i < count; i++)
+            index_of_slot[promises[i] - server.items] = i;
+
+        u32 remaining = count;
+        while (remaining > 0) {
+            auto did_timeout = reader->wait(100_ms);
+            PromiseCompletion completion;
+            while (reader->read(&completion).ok) {
+                u32 index = index_of_slot[completion.promise - server.items];
+                if (promises[index] != completion.promise) continue;
+                if (completion.promise->seq != completion.seq) continue;
+                if (!check(completion.promise, first + index)) return false;
+                promises[index] = nullptr;
+                remaining -= 1;
+            }
+            if (!did_timeout.did_timeout) continue;
+            for (u32 i = 0; i < count; i++) {
+                if (!promises[i] || !promises[i]->is_ready()) continue;
+                if (!check(promises[i], first + i)) return false;
+                promises[i] = nullptr;
+                remaining -= 1;
+                lost += 1;
+            }
+        }
+    }
+    u64 elapsed = core_time_monotonic_ns() - start;
+    printf("completions  %8.1f ns/request in batches of %u, %lu completions lost\n", (f64)elapsed / (f64)rounds, batch, lost);
+    return true;
+}
+
+ErrorOr<int> Main::main(int argc, c_string argv[])
+{
+    auto argument_parser = CLI::ArgumentParser();
+
+    u64 rounds = 100000;
+    TRY(argument_parser.add_option("--rounds"sv, "-r"sv, "count"sv, "requests per run (default: 100000)"sv, [&](c_string arg) {
+        rounds = strtoull(arg, nullptr, 10);
+    }));
+
+    u32 batch = 64;
+    TRY(argument_parser.add_option("--batch"sv, "-b"sv, "count"sv, "requests submitted at once in the completion run (default: 64)"sv, [&](c_string arg) {
+        batch = (u32)strtoul(arg, nullptr, 10);
+    }));
+
+    if (auto result = argument_parser.run(argc, argv); result.is_error()) {
+        TRY(result.error().show());
+        return 1;
+    }
+    if (rounds == 0) {
+        fprintf(stderr, "rounds must be non zero\n");
+        return 1;
+    }
+    if (batch == 0 || batch > batch_max) {
+        fprintf(stderr, "batch must be between 1 and %u\n", batch_max);
+        return 1;
+    }
+
+    if (auto error = mailbox_init(64 * KiB, &worker_mailbox); !error.ok) {
+        fprintf(stderr, "could not create worker mailbox: %s\n", kerror_strerror(error));
+        return 1;
+    }
+    if (auto error = mpsc_mailbox_init(64 * KiB, &completions); !error.ok) {
+        fprintf(stderr, "could not create completion mailbox: %s\n", kerror_strerror(error));
+        return 1;
+    }
+    server = rpc_server_init(&worker_mailbox);
+
+    pthread_t thread;
+    pthread_create(&thread, nullptr, worker, nullptr);
+
+    bool ok = run_await(rounds) && run_completions(rounds, batch);
+
+    (void)server.signal((Stop){});
+    pthread_join(thread, nullptr);
+    mpsc_mailbox_deinit(&completions);
+    return ok ? 0 : 1;
+}
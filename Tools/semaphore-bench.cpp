@@ -0,0 +1,297 @@
+#include <Basic/Verify.h>
+#include <LibCLI/ArgumentParser.h>
+#include <LibCore/Time.h>
+#include <LibMain/Main.h>
+#include <LibThread/Semaphore.h>
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#if TARGET_OS_OSX
+#include <mach/kern_return.h>
+#include <mach/mach_init.h>
+#include <mach/semaphore.h>
+#include <mach/sync_policy.h>
+#endif
+
+static constexpr u32 thread_max = 64;
+
+// NOTE: The baseline, what every signal and wait used to cost: a counter
+//       behind a lock with the kernel involved whenever anyone sleeps.
+typedef struct {
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+    i32 count;
+} CondSemaphore;
+
+static void cond_init(CondSemaphore* sem)
+{
+    pthread_mutex_init(&sem->lock, nullptr);
+    pthread_cond_init(&sem->changed, nullptr);
+    sem->count = 0;
+}
+
+static void cond_deinit(CondSemaphore* sem)
+{
+    pthread_cond_destroy(&sem->changed);
+    pthread_mutex_destroy(&sem->lock);
+}
+
+static void cond_signal(CondSemaphore* sem)
+{
+    pthread_mutex_lock(&sem->lock);
+    sem->count += 1;
+    pthread_cond_signal(&sem->changed);
+    pthread_mutex_unlock(&sem->lock);
+}
+
+static void cond_wait(CondSemaphore* sem)
+{
+    pthread_mutex_lock(&sem->lock);
+    while (sem->count == 0)
+        pthread_cond_wait(&sem->changed, &sem->lock);
+    sem->count -= 1;
+    pthread_mutex_unlock(&sem->lock);
+}
+
+#if TARGET_OS_OSX
+// NOTE: What THSemaphore parks on, a mach semaphore used directly enters
+//       the kernel on every signal and wait.
+typedef struct {
+    semaphore_t event;
+} MachSemaphore;
+
+static void mach_init(MachSemaphore* sem)
+{
+    kern_return_t rv = semaphore_create(mach_task_self(), &sem->event, SYNC_POLICY_FIFO, 0);
+    VERIFY(rv == KERN_SUCCESS);
+}
+
+static void mach_deinit(MachSemaphore* sem)
+{
+    semaphore_destroy(mach_task_self(), sem->event);
+}
+
+static void mach_signal(MachSemaphore* sem)
+{
+    semaphore_signal(sem->event);
+}
+
+static void mach_wait(MachSemaphore* sem)
+{
+    while (semaphore_wait(sem->event) == KERN_ABORTED);
+}
+#endif
+
+typedef enum SemaphoreKind : u8 {
+    SemaphoreKind_Cond,
+    SemaphoreKind_Mach,
+    SemaphoreKind_TH,
+} SemaphoreKind;
+
+static c_string kind_name(SemaphoreKind kind)
+{
+    switch (kind) {
+    case SemaphoreKind_Cond: return "condvar";
+    case SemaphoreKind_Mach: return "mach";
+    case SemaphoreKind_TH: return "THSem";
+    }
+    UNREACHABLE();
+}
+
+typedef struct {
+    SemaphoreKind kind;
+    THSemaphore th[2];
+    CondSemaphore cond[2];
+#if TARGET_OS_OSX
+    MachSemaphore mach[2];
+#endif
+} Pair;
+
+static void pair_init(Pair* pair, u32 index)
+{
+    switch (pair->kind) {
+    case SemaphoreKind_Cond: return cond_init(&pair->cond[index]);
+#if TARGET_OS_OSX
+    case SemaphoreKind_Mach: return mach_init(&pair->mach[index]);
+#else
+    case SemaphoreKind_Mach: UNREACHABLE();
+#endif
+    case SemaphoreKind_TH: return th_sem_init(&pair->th[index], 0);
+    }
+}
+
+static void pair_deinit(Pair* pair, u32 index)
+{
+    switch (pair->kind) {
+    case SemaphoreKind_Cond: return cond_deinit(&pair->cond[index]);
+#if TARGET_OS_OSX
+    case SemaphoreKind_Mach: return mach_deinit(&pair->mach[index]);
+#else
+    case SemaphoreKind_Mach: UNREACHABLE();
+#endif
+    case SemaphoreKind_TH: return th_sem_deinit(&pair->th[index]);
+    }
+}
+
+static void pair_signal(Pair* pair, u32 index)
+{
+    switch (pair->kind) {
+    case SemaphoreKind_Cond: return cond_signal(&pair->cond[index]);
+#if TARGET_OS_OSX
+    case SemaphoreKind_Mach: return mach_signal(&pair->mach[index]);
+#else
+    case SemaphoreKind_Mach: UNREACHABLE();
+#endif
+    case SemaphoreKind_TH: return th_sem_signal(&pair->th[index]);
+    }
+}
+
+static void pair_wait(Pair* pair, u32 index)
+{
+    switch (pair->kind) {
+    case SemaphoreKind_Cond: return cond_wait(&pair->cond[index]);
+#if TARGET_OS_OSX
+    case SemaphoreKind_Mach: return mach_wait(&pair->mach[index]);
+#else
+    case SemaphoreKind_Mach: UNREACHABLE();
+#endif
+    case SemaphoreKind_TH: return (void)th_sem_wait(&pair->th[index]);
+    }
+}
+
+typedef struct {
+    Pair* pair;
+    u64 rounds;
+} PingPong;
+
+static void* pong(void* user)
+{
+    auto* ping_pong = (PingPong*)user;
+    for (u64 i = 0; i < ping_pong->rounds; i++) {
+        pair_wait(ping_pong->pair, 0);
+        pair_signal(ping_pong->pair, 1);
+    }
+    return nullptr;
+}
+
+// NOTE: One token bounced between two threads, the fork-join and request
+//       reply pattern, every wait has a signal arriving right behind it.
+static void run_ping_pong(SemaphoreKind kind, u64 rounds)
+{
+    Pair pair = { .kind = kind };
+    for (u32 i = 0; i < 2; i++)
+        pair_init(&pair, i);
+
+    PingPong ping_pong = { .pair = &pair, .rounds = rounds };
+    pthread_t thread;
+    pthread_create(&thread, nullptr, pong, &ping_pong);
+
+    u64 start = core_time_monotonic_ns();
+    for (u64 i = 0; i < rounds; i++) {
+        pair_signal(&pair, 0);
+        pair_wait(&pair, 1);
+    }
+    u64 elapsed = core_time_monotonic_ns() - start;
+    pthread_join(thread, nullptr);
+
+    for (u32 i = 0; i < 2; i++)
+        pair_deinit(&pair, i);
+    printf("ping-pong  %-8s %8.1f ns/round trip\n", kind_name(kind), (f64)elapsed / (f64)rounds);
+}
+
+typedef struct {
+    Pair* pair;
+    u64 count;
+} Side;
+
+static void* produce(void* user)
+{
+    auto* side = (Side*)user;
+    for (u64 i = 0; i < side->count; i++)
+        pair_signal(side->pair, 0);
+    return nullptr;
+}
+
+static void* consume(void* user)
+{
+    auto* side = (Side*)user;
+    for (u64 i = 0; i < side->count; i++)
+        pair_wait(side->pair, 0);
+    return nullptr;
+}
+
+// NOTE: Many signallers and many waiters on one semaphore, the shape of
+//       workers parking on the dispatch queue while work is handed out.
+static void run_contended(SemaphoreKind kind, u32 producers, u32 consumers, u64 tokens)
+{
+    Pair pair = { .kind = kind };
+    pair_init(&pair, 0);
+
+    pthread_t threads[thread_max * 2];
+    Side sides[thread_max * 2];
+    u64 per_producer = tokens / producers;
+    u64 total = per_producer * producers;
+
+    u64 start = core_time_monotonic_ns();
+    for (u32 i = 0; i < consumers; i++) {
+        sides[i] = (Side){ .pair = &pair, .count = total / consumers + (i < total % consumers ? 1 : 0) };
+        pthread_create(&threads[i], nullptr, consume, &sides[i]);
+    }
+    for (u32 i = 0; i < producers; i++) {
+        sides[consumers + i] = (Side){ .pair = &pair, .count = per_producer };
+        pthread_create(&threads[consumers + i], nullptr, produce, &sides[consumers + i]);
+    }
+    for (u32 i = 0; i < producers + consumers; i++)
+        pthread_join(threads[i], nullptr);
+    u64 elapsed = core_time_monotonic_ns() - start;
+
+    pair_deinit(&pair, 0);
+    printf("contended  %-8s %2u -> %2u threads: %8.1f ns/token, %6.2f Mtoken/s\n", kind_name(kind), producers, consumers, (f64)elapsed / (f64)total, (f64)total / ((f64)elapsed / 1e3));
+}
+
+ErrorOr<int> Main::main(int argc, c_string argv[])
+{
+    auto argument_parser = CLI::ArgumentParser();
+
+    u64 rounds = 200000;
+    TRY(argument_parser.add_option("--rounds"sv, "-r"sv, "count"sv, "ping-pong round trips and contended tokens (default: 200000)"sv, [&](c_string arg) {
+        rounds = strtoull(arg, nullptr, 10);
+    }));
+
+    u32 thread_count = 4;
+    TRY(argument_parser.add_option("--threads"sv, "-t"sv, "count"sv, "producers and consumers each for the contended run (default: 4)"sv, [&](c_string arg) {
+        thread_count = (u32)strtoul(arg, nullptr, 10);
+    }));
+
+    if (auto result = argument_parser.run(argc, argv); result.is_error()) {
+        TRY(result.error().show());
+        return 1;
+    }
+    if (rounds == 0) {
+        fprintf(stderr, "rounds must be non zero\n");
+        return 1;
+    }
+    if (thread_count == 0 || thread_count > thread_max) {
+        fprintf(stderr, "threads must be between 1 and %u\n", thread_max);
+        return 1;
+    }
+
+    // NOTE: THSemaphore parks on a mach semaphore on macOS, compare against
+    //       that as well as the condvar it replaced.
+    static constexpr SemaphoreKind kinds[] = {
+        SemaphoreKind_Cond,
+#if TARGET_OS_OSX
+        SemaphoreKind_Mach,
+#endif
+        SemaphoreKind_TH,
+    };
+    for (auto kind : kinds)
+        run_ping_pong(kind, rounds);
+    for (auto kind : kinds)
+        run_contended(kind, 1, thread_count, rounds);
+    for (auto kind : kinds)
+        run_contended(kind, thread_count, thread_count, rounds);
+    return 0;
+}
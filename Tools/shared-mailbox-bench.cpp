@@ -0,0 +1,151 @@
+#include <Basic/SharedMailbox.h>
+#include <LibCLI/ArgumentParser.h>
+#include <LibCore/Time.h>
+#include <LibMain/Main.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+static constexpr u32 block_frames = 256;
+static constexpr u32 block_channels = 2;
+
+DEFINE_MESSAGE(AudioBlock) {
+    u64 sequence;
+    u64 sent_ns;
+    f32 samples[block_frames * block_channels];
+};
+
+DEFINE_MESSAGE(BenchDone) {
+    u64 sequence;
+};
+
+static int compare_u64(void const* a, void const* b)
+{
+    u64 x = *(u64 const*)a;
+    u64 y = *(u64 const*)b;
+    return (x > y) - (x < y);
+}
+
+static int consume(SharedMailbox* mailbox, u64 block_count)
+{
+    auto* latencies = (u64*)calloc(block_count, sizeof(u64));
+    if (!latencies) {
+        fprintf(stderr, "out of memory\n");
+        return 1;
+    }
+
+    u64 received = 0;
+    f32 checksum = 0;
+    u64 start = 0;
+    for (bool done = false; !done;) {
+        mailbox->wait();
+        u16 tag = 0;
+        void const* data = nullptr;
+        u64 size = 0;
+        while (mailbox->peek_span(&tag, &data, &size).found) {
+            if (tag == Ty2::type_id<BenchDone>()) {
+                done = true;
+                break;
+            }
+            if (tag != Ty2::type_id<AudioBlock>()) {
+                fprintf(stderr, "unexpected message tag %u\n", tag);
+                return 1;
+            }
+            // NOTE: Used in place, the samples are never copied out of the ring.
+            auto const* block = (AudioBlock const*)data;
+            u64 now = core_time_monotonic_ns();
+            if (received == 0) start = block->sent_ns;
+            if (received < block_count) latencies[received] = now - block->sent_ns;
+            checksum += block->samples[block->sequence % (block_frames * block_channels)];
+            received += 1;
+        }
+        mailbox->release();
+    }
+    u64 elapsed = core_time_monotonic_ns() - start;
+
+    u64 count = received < block_count ? received : block_count;
+    qsort(latencies, count, sizeof(u64), compare_u64);
+    f64 seconds = (f64)elapsed / 1e9;
+    f64 bytes = (f64)received * (f64)sizeof(AudioBlock);
+    printf("blocks:     %llu (%u frames x %u channels, checksum %f)\n", (unsigned long long)received, block_frames, block_channels, (f64)checksum);
+    printf("throughput: %.0f blocks/s, %.1f MiB/s\n", (f64)received / seconds, bytes / seconds / (1024.0 * 1024.0));
+    if (count > 0) {
+        printf("latency:    p50 %.1f us, p99 %.1f us, max %.1f us\n",
+            (f64)latencies[count / 2] / 1e3,
+            (f64)latencies[(count * 99) / 100] / 1e3,
+            (f64)latencies[count - 1] / 1e3);
+    }
+    free(latencies);
+    return received == block_count ? 0 : 1;
+}
+
+static int produce(SharedMailbox* mailbox, u64 block_count)
+{
+    for (u64 sequence = 0; sequence < block_count; sequence++) {
+        AudioBlock* block = nullptr;
+        while (!mailbox->reserve(&block).ok)
+            sched_yield();
+        block->sequence = sequence;
+        for (u32 i = 0; i < block_frames * block_channels; i++)
+            block->samples[i] = (f32)(sequence + i) * 0x1p-20f;
+        block->sent_ns = core_time_monotonic_ns();
+        mailbox->commit();
+    }
+
+    while (!mailbox->post(BenchDone{ block_count }).ok)
+        sched_yield();
+    return 0;
+}
+
+ErrorOr<int> Main::main(int argc, c_string argv[])
+{
+    auto argument_parser = CLI::ArgumentParser();
+
+    u64 block_count = 100000;
+    TRY(argument_parser.add_option("--blocks"sv, "-n"sv, "count"sv, "number of audio blocks to send (default: 100000)"sv, [&](c_string arg) {
+        block_count = strtoull(arg, nullptr, 10);
+    }));
+
+    u32 capacity = 256 * 1024;
+    TRY(argument_parser.add_option("--capacity"sv, "-c"sv, "bytes"sv, "ring capacity in bytes (default: 262144)"sv, [&](c_string arg) {
+        capacity = (u32)strtoul(arg, nullptr, 10);
+    }));
+
+    if (auto result = argument_parser.run(argc, argv); result.is_error()) {
+        TRY(result.error().show());
+        return 1;
+    }
+
+    SharedMailbox mailbox = {};
+    if (auto result = shared_mailbox_create(capacity, &mailbox); !result.ok) {
+        fprintf(stderr, "could not create shared mailbox: %s\n", kerror_tstring(result));
+        return 1;
+    }
+
+    // NOTE: The consumer opens its own mapping of the fd, so it sees the
+    //       ring at a different address than the producer, as a separately
+    //       launched helper would.
+    pid_t pid = fork();
+    if (pid < 0) return Error::from_string_literal_with_errno("could not fork");
+    if (pid == 0) {
+        SharedMailbox consumer = {};
+        if (auto result = shared_mailbox_open(dup(mailbox.fd), &consumer); !result.ok) {
+            fprintf(stderr, "could not open shared mailbox: %s\n", kerror_tstring(result));
+            _exit(1);
+        }
+        int status = consume(&consumer, block_count);
+        shared_mailbox_close(&consumer);
+        fflush(stdout);
+        _exit(status);
+    }
+
+    int result = produce(&mailbox, block_count);
+
+    int status = 0;
+    if (waitpid(pid, &status, 0) < 0) return Error::from_string_literal_with_errno("could not wait for consumer");
+    shared_mailbox_close(&mailbox);
+    if (result != 0) return result;
+    return WIFEXITED(status) ? WEXITSTATUS(status) : 1;
+}
@@ -14,8 +14,11 @@
 
 ErrorOr<int> Main::main(int argc, c_string argv[])
 {
+    // NOTE: Reserved, not allocated, watching a handful of files only ever
+    //       commits the first few granules.
     constexpr u64 arena_size = 16LLU * 1024LLU * 1024LLU * 1024LLU;
-    auto arena_instance = fixed_arena_init(page_alloc(arena_size), arena_size);
+    FixedArena arena_instance;
+    VERIFY(fixed_arena_init_virtual(arena_size, false, &arena_instance));
     auto* arena = &arena_instance.allocator;
 
     auto argument_parser = CLI::ArgumentParser();